@@ -81,7 +81,7 @@ namespace Libshit::Lua
 //$     if v.type == "constant" then
     bld.Add("/*$= k */", /*$= v.value_str */);
 //$     else
-    bld.AddFunction<
+    bld./*$= v.ffi and "AddFfiFunction" or "AddFunction" */<
 //$       for i,m in ipairs(v) do
       /*$= m.value_str *//*$= i == #v and '' or ',' */
 //$       end
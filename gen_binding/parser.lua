@@ -293,6 +293,12 @@ local function lua_function(c, tbl, parent)
   assert(tbl.class)
   assert(tbl.value_tmpl)
   assert(tbl.type)
+
+  if tbl.ffi and not (c:kind() == "FunctionDecl" or
+                      (c:kind() == "CXXMethod" and c:isStatic())) then
+    utils.print_error("ffi only works with freestanding/static functions", c)
+    return
+  end
   tbl.value_str = template(tbl.value_tmpl, info, c)
 
   -- store entry
@@ -526,8 +532,22 @@ local function parse(c, filter)
 
   local ret = inst.ret_lua_classes
   for _,c in ipairs(ret) do
-    for _,m in pairs(c.entries) do
+    for k,m in pairs(c.entries) do
       sort(m, function(a,b) return a.order < b.order end)
+
+      -- ffi functions can't be overloaded, they're a single function pointer
+      if m.type == "function" then
+        if #m == 1 then
+          m.ffi = m[1].ffi
+        else
+          for _,f in ipairs(m) do
+            if f.ffi then
+              utils.print_warning("ffi ignored on overloaded function "..
+                                    c.name.."."..k)
+            end
+          end
+        end
+      end
     end
   end
 
@@ -37,6 +37,12 @@ namespace Libshit::Abomination
 
   inline int unlink(const char* fname)
   { return _wunlink(Wtf8ToWtf16Wstr(fname).c_str()); }
+  // unlike on posix, fails if `to` exists
+  inline int rename(const char* from, const char* to)
+  {
+    return _wrename(Wtf8ToWtf16Wstr(from).c_str(),
+                    Wtf8ToWtf16Wstr(to).c_str());
+  }
 
   // rage time: there's no setenv on windows, only the horrible putenv. There's
   // also GetEnvironmentVariable and SetEnvironmentVariable winapi functions.
@@ -75,6 +81,7 @@ namespace Libshit::Abomination
   using std::fopen;
   using std::freopen;
   using ::unlink;
+  using std::rename;
   using ::getenv;
   using ::setenv;
   using ::unsetenv;
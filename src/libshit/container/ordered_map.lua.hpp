@@ -112,7 +112,7 @@ namespace Libshit
       Libshit::Lua::RawTable tbl)
     {
       LIBSHIT_LUA_GETTOP(vm, top);
-      lua_rawgetp(vm, LUA_REGISTRYINDEX, Libshit::Lua::TypeTraits<T>::TAG + 1); // +1
+      Libshit::Lua::GetRegisteredType(vm, Libshit::Lua::TypeTraits<T>::TAG + 1); // +1
       auto newidx = lua_absindex(vm, -1);
       vm.Ipairs01(tbl, [&](size_t, int type)
       {
@@ -47,6 +47,13 @@ namespace Libshit::Lua
     LIBSHIT_COMP_CHECK(Lt, LT, <);
 #undef LIBSHIT_COMP_CHECK
 
+    // types that can be copied to/from lua numbers without going through
+    // TypeTraits/AutoTable for every element. vector<bool> is excluded, it's
+    // neither a number in lua nor contiguous in c++.
+    template <typename T>
+    constexpr inline bool IS_BULK_NUMBER =
+      std::is_arithmetic_v<T> && !std::is_same_v<T, bool>;
+
   }
 
   template <typename T, typename Allocator = std::allocator<T>>
@@ -125,12 +132,23 @@ namespace Libshit::Lua
     static Libshit::Lua::RetNum ToTable(Libshit::Lua::StateRef vm, Vect& v)
     {
       auto size = v.size();
-      lua_createtable(vm, size ? size-1 : size, 0);
-      for (size_t i = 0; i < size; ++i)
+      // index 0 goes into the hash part
+      lua_createtable(vm, size ? size-1 : 0, size ? 1 : 0);
+      if constexpr (Detail::IS_BULK_NUMBER<T>)
       {
-        vm.Push(v[i]);
-        lua_rawseti(vm, -2, i);
+        auto ptr = v.data();
+        for (size_t i = 0; i < size; ++i)
+        {
+          lua_pushnumber(vm, lua_Number(ptr[i]));
+          lua_rawseti(vm, -2, i);
+        }
       }
+      else
+        for (size_t i = 0; i < size; ++i)
+        {
+          vm.Push(v[i]);
+          lua_rawseti(vm, -2, i);
+        }
       return 1;
     }
 
@@ -139,11 +157,26 @@ namespace Libshit::Lua
       Libshit::Lua::StateRef vm, Vect& v, Libshit::Lua::RawTable tbl)
     {
       auto [len, one] = vm.RawLen01(tbl);
-      v.reserve(v.size() + len);
-      vm.Fori(tbl, one, len, [&](size_t, int)
+      if constexpr (Detail::IS_BULK_NUMBER<T>)
+      {
+        // convert before appending: Get can raise a lua error at any element,
+        // don't leave zero filled elements behind
+        v.reserve(v.size() + len);
+        for (size_t i = 0; i < len; ++i)
+        {
+          lua_rawgeti(vm, tbl, i + one); // +1
+          v.push_back(TypeTraits<T>::template Get<false>(vm, false, -1));
+          lua_pop(vm, 1); // 0
+        }
+      }
+      else
       {
-        v.push_back(vm.Get<Libshit::Lua::AutoTable<T>>(-1));
-      });
+        v.reserve(v.size() + len);
+        vm.Fori(tbl, one, len, [&](size_t, int)
+        {
+          v.push_back(vm.Get<Libshit::Lua::AutoTable<T>>(-1));
+        });
+      }
     }
 
     static auto FromTable(Libshit::Lua::StateRef vm, Libshit::Lua::RawTable tbl)
@@ -160,6 +193,30 @@ namespace Libshit::Lua
       return v;
     }
 
+#if LIBSHIT_LUA_HAS_FFI
+    /**
+     * Returns the vector's buffer as an ffi pointer cdata, so lua code can
+     * read/write the elements without crossing into C++ for each of them.
+     * Returns nil if the ffi module can't be loaded.
+     * @warning The returned pointer doesn't keep the vector alive and it's
+     *   invalidated by anything that reallocates the vector.
+     */
+    static Libshit::Lua::RetNum Data(Libshit::Lua::StateRef vm, Vect& v)
+    {
+      if (lua_getfield(vm, LUA_REGISTRYINDEX, "libshit_ffi_cast") != // +1
+          LUA_TFUNCTION)
+      {
+        lua_pop(vm, 1); // 0
+        lua_pushnil(vm); // +1
+        return 1;
+      }
+      lua_pushfstring(vm, "%s*", Detail::FfiType<T>::NAME); // +2
+      lua_pushlightuserdata(vm, v.data()); // +3
+      lua_call(vm, 2, 1); // +1
+      return 1;
+    }
+#endif
+
     static void Register(Libshit::Lua::TypeBuilder& bld)
     {
       if constexpr (std::is_default_constructible_v<T>)
@@ -208,6 +265,11 @@ namespace Libshit::Lua
           static_cast<void (Vect::*)(size_type, const T&)>(&Vect::resize)
         >("resize");
       bld.AddFunction<&ToTable>("to_table");
+#if LIBSHIT_LUA_HAS_FFI
+      if constexpr (Detail::IS_BULK_NUMBER<T> &&
+                    Detail::FfiType<T>::NAME != nullptr)
+        bld.AddFunction<&Data>("data");
+#endif
 
       if constexpr (Detail::IS_EQ_COMP<T>)
         bld.AddFunction<
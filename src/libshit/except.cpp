@@ -2,6 +2,8 @@
 
 #include "libshit/assert.hpp"
 #include "libshit/doctest.hpp"
+#include "libshit/logger.hpp"
+#include "libshit/options.hpp"
 #include "libshit/platform.hpp"
 
 // do not use, unless you have to: very slow (executes addr2line for *each*
@@ -16,18 +18,22 @@
 #include <boost/core/demangle.hpp>
 #include <boost/stacktrace.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <iomanip>
-#include <map>
 #include <memory>
+#include <mutex>
 #include <new>
 #include <optional>
 #include <system_error>
 #include <typeinfo>
+#include <unordered_map>
 #include <variant>
+#include <vector>
 
 #if LIBSHIT_OS_IS_WINDOWS
 #  include "libshit/wtf8.hpp"
@@ -47,8 +53,71 @@ namespace Libshit
 {
   TEST_SUITE_BEGIN("Libshit::Except");
 
+  static std::size_t CaptureStacktrace(
+    void** frames, std::size_t max_frames) noexcept
+  {
+#ifndef BOOST_STACKTRACE_USE_NOOP
+    // no allocation, just an unwinder walk storing return addresses.
+    // safe_dump_to needs place for a terminating null frame
+    void* buf[EXCEPTION_MAX_FRAMES + 1];
+    if (max_frames > EXCEPTION_MAX_FRAMES) max_frames = EXCEPTION_MAX_FRAMES;
+    auto n = boost::stacktrace::safe_dump_to(
+      1, buf, (max_frames + 1) * sizeof(void*));
+    if (n > 0) --n;
+    std::copy(buf, buf + n, frames);
+    return n;
+#else
+    return 0;
+#endif
+  }
+
+#ifndef BOOST_STACKTRACE_USE_NOOP
+  namespace
+  {
+    struct SymbolInfo
+    {
+      std::string name, source_file, module;
+      std::size_t source_line;
+    };
+
+    // symbolizing is slow (especially with libbacktrace), and exceptions thrown
+    // from the same place tend to be printed over and over
+    struct SymbolCache
+    {
+      std::mutex mutex;
+      std::unordered_map<const void*, SymbolInfo> map;
+    };
+  }
+
+  static SymbolCache& GetSymbolCache()
+  {
+    static SymbolCache cache;
+    return cache;
+  }
+
+  static SymbolInfo GetSymbolInfo(const void* addr)
+  {
+    auto& cache = GetSymbolCache();
+    {
+      std::lock_guard lock{cache.mutex};
+      auto it = cache.map.find(addr);
+      if (it != cache.map.end()) return it->second;
+    }
+
+    boost::stacktrace::frame frame{addr};
+    SymbolInfo info{frame.name(), {}, {}, frame.source_line()};
+    if (info.source_line) info.source_file = frame.source_file();
+    // uh-oh
+    boost::stacktrace::detail::location_from_symbol loc(addr);
+    if (!loc.empty()) info.module = loc.name();
+
+    std::lock_guard lock{cache.mutex};
+    return cache.map.emplace(addr, Move(info)).first->second;
+  }
+#endif
+
   static void PrintStacktrace(
-    std::ostream& os, const boost::stacktrace::stacktrace& trace, bool color)
+    std::ostream& os, void* const* frames, std::size_t n, bool color)
   {
 #ifndef BOOST_STACKTRACE_USE_NOOP
     if (color) os << "\033[1m";
@@ -57,39 +126,36 @@ namespace Libshit
     os << ":\n";
     auto flags = os.flags();
     os.width(0);
-    for (std::size_t i = 0, n = trace.size(); i < n; ++i)
+    for (std::size_t i = 0; i < n; ++i)
     {
+      auto info = GetSymbolInfo(frames[i]);
       if (color) os << "\033[37m";
       os << std::setw(4) << std::setfill(' ') << i << ": ";
       if (color) os << "\033[36m";
       os << std::setw(sizeof(void*)*2) << std::setfill('0') << std::hex
-         << reinterpret_cast<std::uintptr_t>(trace[i].address()) << std::dec;
+         << reinterpret_cast<std::uintptr_t>(frames[i]) << std::dec;
       if (color) os << "\033[33m";
-      auto name = trace[i].name();
-      if (name.empty()) os << " ??";
-      else os << ' ' << name;
+      if (info.name.empty()) os << " ??";
+      else os << ' ' << info.name;
 
       if (color) os << "\033[37m";
-      auto line = trace[i].source_line();
-      if (line)
+      if (info.source_line)
       {
         os << " at ";
         if (color) os << "\033[32m";
-        os << trace[i].source_file();
+        os << info.source_file;
         if (color) os << "\033[37m";
         os << ':';
         if (color) os << "\033[1;37m";
-        os << line;
+        os << info.source_line;
         if (color) os << "\033[0;37m";
       }
 
-      // uh-oh
-      boost::stacktrace::detail::location_from_symbol loc(trace[i].address());
-      if (!loc.empty())
+      if (!info.module.empty())
       {
         os << " in ";
         if (color) os << "\033[34m";
-        os << loc.name();
+        os << info.module;
       }
 
       if (color) os << "\033[0m";
@@ -99,20 +165,122 @@ namespace Libshit
 #endif
   }
 
+  static_assert(EXCEPTION_MAX_FRAMES == 32, "Update help message");
+  // read by every throw on every thread
+  static std::atomic<std::size_t> exception_trace_depth{
+    LIBSHIT_IS_DEBUG ? EXCEPTION_MAX_FRAMES : 0};
+  void SetExceptionStacktraceDepth(std::size_t depth) noexcept
+  {
+    exception_trace_depth.store(
+      std::min(depth, EXCEPTION_MAX_FRAMES), std::memory_order_relaxed);
+  }
+  std::size_t GetExceptionStacktraceDepth() noexcept
+  { return exception_trace_depth.load(std::memory_order_relaxed); }
+
+  static Option exception_trace_opt{
+    Logger::GetOptionGroup(), "exception-stacktrace", 1, "DEPTH",
+    "Record at most DEPTH stack frames when an exception is thrown, 0 disables"
+    "\n\tMaximum: 32, default: " LIBSHIT_DEBUG("32") LIBSHIT_NOT_DEBUG("0"),
+    [](auto&, auto&& args)
+    {
+      char* end;
+      auto depth = std::strtoul(args.front(), &end, 10);
+      if (*end != '\0')
+        throw InvalidParam{"Invalid stacktrace depth"};
+      SetExceptionStacktraceDepth(depth);
+    }};
+
+  template <typename T>
+  static std::size_t FormatNumber(char* buf, T t) noexcept
+  { return ToCharsTraits<T>::Write(buf, t) - buf; }
+
+  std::size_t ExceptionInfoValue::FormatNumber(
+    char (&buf)[NUMBER_BUF_SIZE]) const noexcept
+  {
+    static_assert(ToCharsTraits<long double>::MAX_SIZE <= NUMBER_BUF_SIZE);
+    switch (kind)
+    {
+    case Kind::SIGNED:      return Libshit::FormatNumber(buf, u.sll);
+    case Kind::UNSIGNED:    return Libshit::FormatNumber(buf, u.ull);
+    case Kind::FLOAT:       return Libshit::FormatNumber(buf, u.f);
+    case Kind::DOUBLE:      return Libshit::FormatNumber(buf, u.d);
+    case Kind::LONG_DOUBLE: return Libshit::FormatNumber(buf, u.ld);
+    default: LIBSHIT_UNREACHABLE("Not a number ExceptionInfoValue");
+    }
+  }
+
+  void ExceptionInfoValue::Print(std::ostream& os) const
+  {
+    switch (kind)
+    {
+    case Kind::STRING: os << str; return;
+    default:
+    {
+      char buf[NUMBER_BUF_SIZE];
+      os.write(buf, FormatNumber(buf));
+      return;
+    }
+    }
+  }
+
+  std::string ExceptionInfoValue::Format() const
+  {
+    switch (kind)
+    {
+    case Kind::STRING: return str;
+    default:
+    {
+      char buf[NUMBER_BUF_SIZE];
+      return {buf, FormatNumber(buf)};
+    }
+    }
+  }
+
+  struct ExceptionInfoEntry
+  {
+    ExceptionInfoKey key;
+    ExceptionInfoValue value;
+  };
+
+  /**
+   * Entries are stored in small fixed size nodes. When an exception is copied,
+   * the copies share the nodes; adding info to a shared node (or to a full one)
+   * creates a new node pointing to the old one instead of copying every entry,
+   * so existing entries are never modified once shared.
+   */
   struct ExceptionInfo
   {
+    static constexpr unsigned INLINE_ENTRIES = 4;
+
     std::atomic<unsigned> refcount = 0;
     const char* file = nullptr;
     unsigned line = 0;
     const char* func = nullptr;
-#if LIBSHIT_IS_DEBUG
-    boost::stacktrace::stacktrace trace;
-#endif
-    std::multimap<std::string, std::string> map;
-
-    ExceptionInfo() = default;
-    ExceptionInfo(const ExceptionInfo& o)
-      : file{o.file}, line{o.line}, func{o.func}, map{o.map} {}
+    unsigned count = 0;
+    ExceptionInfoEntry entries[INLINE_ENTRIES];
+    boost::intrusive_ptr<ExceptionInfo> prev;
+
+    // only symbolized when printed. Only the first node of the chain has it.
+    std::size_t frame_count = 0;
+    void* frames[EXCEPTION_MAX_FRAMES];
+
+    ExceptionInfo() noexcept
+      : frame_count{CaptureStacktrace(
+          frames, exception_trace_depth.load(std::memory_order_relaxed))} {}
+    ExceptionInfo(boost::intrusive_ptr<ExceptionInfo> prev) noexcept
+      : file{prev->file}, line{prev->line}, func{prev->func},
+        prev{Move(prev)} {}
+
+    const ExceptionInfo& GetFirst() const noexcept
+    { return prev ? prev->GetFirst() : *this; }
+
+    /// All entries in insertion order.
+    template <typename Fun>
+    void ForEach(Fun&& fun) const
+    {
+      if (prev) prev->ForEach(fun);
+      for (unsigned i = 0; i < count; ++i) fun(entries[i]);
+    }
   };
 
   void intrusive_ptr_add_ref(ExceptionInfo* ptr)
@@ -123,24 +291,28 @@ namespace Libshit
       delete ptr;
   }
 
-  void Exception::EnsureInfo()
+  void Exception::EnsureInfo(bool add_entry)
   {
     if (!info)
       info.reset(new ExceptionInfo);
-    else if (info->refcount != 1)
-      info.reset(new ExceptionInfo{*info});
+    else if (info->refcount != 1 ||
+             (add_entry && info->count == ExceptionInfo::INLINE_ENTRIES))
+      info.reset(new ExceptionInfo{Move(info)});
   }
 
-  void Exception::AddInfo(std::string key, std::string value)
+  void Exception::AddInfo(ExceptionInfoKey key, ExceptionInfoValue value)
   {
-    EnsureInfo();
-    info->map.emplace(Move(key), Move(value));
+    EnsureInfo(true);
+    auto& e = info->entries[info->count];
+    e.key = Move(key);
+    e.value = Move(value);
+    ++info->count;
   }
 
   void Exception::AddLocation(
     const char* file, unsigned int line, const char* func)
   {
-    EnsureInfo();
+    EnsureInfo(false);
     info->file = file;
     info->line = line;
     info->func = func;
@@ -172,28 +344,276 @@ namespace Libshit
     }
     os << "\n";
 
-    for (auto& e : info->map)
+    // sorted by key, like the old multimap based implementation
+    std::vector<const ExceptionInfoEntry*> entries;
+    info->ForEach([&](const ExceptionInfoEntry& e) { entries.push_back(&e); });
+    std::stable_sort(
+      entries.begin(), entries.end(),
+      [](const ExceptionInfoEntry* a, const ExceptionInfoEntry* b)
+      { return std::strcmp(a->key.Get(), b->key.Get()) < 0; });
+
+    for (auto e : entries)
     {
       if (color) os << "\033[1m";
-      os << e.first;
+      os << e->key.Get();
       if (color) os << "\033[22m";
-      os << ": " << e.second << '\n';
+      os << ": ";
+      e->value.Print(os);
+      os << '\n';
     }
 
-#if LIBSHIT_IS_DEBUG
-    PrintStacktrace(os, info->trace, color);
-#endif
+    auto& first = info->GetFirst();
+    if (first.frame_count)
+      PrintStacktrace(os, first.frames, first.frame_count, color);
   }
 
   std::string Exception::operator[](const std::string& key) const
   {
     if (!info) return {};
-    auto& map = info->map;
-    auto it = map.find(key);
-    if (it == map.end()) return {};
-    return it->second;
+    const ExceptionInfoEntry* res = nullptr;
+    info->ForEach([&](const ExceptionInfoEntry& e)
+    { if (!res && key == e.key.Get()) res = &e; });
+    return res ? res->value.Format() : std::string{};
   }
 
+  TEST_CASE("exception info")
+  {
+    std::runtime_error base{"foo"};
+    EnableErrorInfo<std::runtime_error> e{base};
+    CHECK(e["Key"] == "");
+
+    std::string dyn_key = "Dyn";
+    AddInfos(e, "Key", "val", "Int", -12, "Unsigned", 7u, "Double", 1.5,
+             dyn_key, std::string{"str"}, "Char", 'a', "Ptr",
+             static_cast<const char*>("ptr"));
+    dyn_key = "xxx";
+    CHECK(e["Key"] == "val");
+    CHECK(e["Int"] == "-12");
+    CHECK(e["Unsigned"] == "7");
+    CHECK(e["Double"] == "1.5");
+    CHECK(e["Dyn"] == "str");
+    CHECK(e["xxx"] == "");
+    CHECK(e["Char"] == "a");
+    CHECK(ToString('a') == "a");
+    CHECK(ToString(1.5) == "1.5");
+    CHECK(e["Ptr"] == "ptr");
+
+    // copies share the old entries, but additions are not visible in the other
+    auto e2 = e;
+    e2.AddInfo("Key", "other");
+    e2.AddInfo("New", 1);
+    e.AddInfo("Old", 2);
+    CHECK(e2["Key"] == "val");
+    CHECK(e2["New"] == "1");
+    CHECK(e2["Old"] == "");
+    CHECK(e["New"] == "");
+    CHECK(e["Old"] == "2");
+
+    std::stringstream ss;
+    e2.PrintDesc(ss, false);
+    auto str = ss.str();
+    CHECK(str.find("Char: a\nDouble: 1.5\nDyn: str\nInt: -12\n"
+                   "Key: val\nKey: other\nNew: 1\nPtr: ptr\nUnsigned: 7\n")
+          != std::string::npos);
+
+    // const char arrays are not necessarily literals, they must be copied
+    char buf[] = "local";
+    const char (&cbuf)[sizeof(buf)] = buf;
+    e.AddInfo("Local", cbuf);
+    buf[0] = 'X';
+    CHECK(e["Local"] == "local");
+
+    // keys too, unless explicitly marked static
+    char key_buf[] = "Local key";
+    e.AddInfo(key_buf, 1);
+    key_buf[0] = 'X';
+    CHECK(e["Local key"] == "1");
+    e.AddInfo(ExceptionInfoKey::StaticKey{"Static"}, 2);
+    CHECK(e["Static"] == "2");
+  }
+
+  TEST_CASE("exception stacktrace")
+  {
+    auto old_depth = GetExceptionStacktraceDepth();
+    AtScopeExit x{[&]() { SetExceptionStacktraceDepth(old_depth); }};
+    auto get = []()
+    {
+      std::stringstream ss;
+      LIBSHIT_GET_EXCEPTION(std::runtime_error, "foo").PrintDesc(ss, false);
+      return ss.str();
+    };
+
+    SetExceptionStacktraceDepth(0);
+    CHECK(get().find("Stacktrace") == std::string::npos);
+
+#ifndef BOOST_STACKTRACE_USE_NOOP
+    SetExceptionStacktraceDepth(4);
+    std::string strs[2];
+    // second time symbols come from the cache
+    for (auto& str : strs) str = get();
+    CHECK(strs[0].find("Stacktrace") != std::string::npos);
+    CHECK(strs[0].find("   4: ") == std::string::npos);
+    CHECK(strs[0] == strs[1]);
+#endif
+
+    SetExceptionStacktraceDepth(1000);
+    CHECK(GetExceptionStacktraceDepth() == EXCEPTION_MAX_FRAMES);
+  }
+
+#if LIBSHIT_EXCEPTION_STATS
+  std::atomic<bool> ThrowSite::enabled{false};
+  // sites are never destroyed before exit, a lock-free list is enough
+  static std::atomic<ThrowSite*> throw_sites{nullptr};
+
+  static std::atomic<std::int64_t> stats_log_interval{0}, stats_next_log{0};
+  static std::int64_t GetNowSec() noexcept
+  {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static void LogThrowStats()
+  {
+    if (!CHECK_INF) return;
+    auto& log = Logger::Log(
+      LIBSHIT_LOG_NAME, Logger::INFO, nullptr, 0, nullptr);
+    log << "Exception stats:\n";
+    DumpThrowStats(log);
+    log.flush();
+  }
+
+  ThrowSite::ThrowSite(const char* file, unsigned line) noexcept
+    : file{file}, line{line},
+      next{throw_sites.load(std::memory_order_relaxed)}
+  {
+    while (!throw_sites.compare_exchange_weak(
+             next, this, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  void ThrowSite::Add(const char* func) noexcept
+  {
+    this->func.store(func, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+
+    auto interval = stats_log_interval.load(std::memory_order_relaxed);
+    if (interval == 0) return;
+    auto now = GetNowSec();
+    auto next = stats_next_log.load(std::memory_order_relaxed);
+    if (now < next || !stats_next_log.compare_exchange_strong(
+          next, now + interval, std::memory_order_relaxed))
+      return;
+    try { LogThrowStats(); } catch (...) {}
+  }
+
+  std::vector<ThrowStat> GetThrowStats()
+  {
+    std::vector<ThrowStat> res;
+    for (auto s = throw_sites.load(std::memory_order_acquire); s; s = s->next)
+    {
+      auto count = s->count.load(std::memory_order_relaxed);
+      if (count == 0) continue;
+      res.push_back({
+          s->file, s->line, s->func.load(std::memory_order_relaxed), count});
+    }
+    std::sort(res.begin(), res.end(), [](const ThrowStat& a, const ThrowStat& b)
+              { return a.count > b.count; });
+    return res;
+  }
+
+  void ResetThrowStats() noexcept
+  {
+    for (auto s = throw_sites.load(std::memory_order_acquire); s; s = s->next)
+      s->count.store(0, std::memory_order_relaxed);
+  }
+
+  void DumpThrowStats(std::ostream& os)
+  {
+    auto flags = os.flags();
+    for (const auto& s : GetThrowStats())
+    {
+      os << std::setw(10) << s.count << "  " << s.file << ':' << s.line;
+      if (s.func) os << " in " << s.func;
+      os << '\n';
+    }
+    os.flags(flags);
+  }
+
+  namespace
+  {
+    struct ThrowStatsAtExit
+    {
+      ~ThrowStatsAtExit()
+      {
+        if (!log) return;
+        try { LogThrowStats(); } catch (...) {}
+      }
+      bool log = false;
+    };
+  }
+  static ThrowStatsAtExit throw_stats_at_exit;
+
+  void SetThrowStatsLogInterval(std::chrono::seconds interval) noexcept
+  {
+    stats_log_interval.store(interval.count(), std::memory_order_relaxed);
+    stats_next_log.store(GetNowSec() + interval.count(),
+                         std::memory_order_relaxed);
+    throw_stats_at_exit.log = true;
+    ThrowSite::SetEnabled(true);
+  }
+
+  static Option exception_stats_opt{
+    Logger::GetOptionGroup(), "exception-stats", 1, "SECONDS",
+    "Count thrown exceptions per throw site and log them every SECONDS "
+    "seconds (0: only at exit)",
+    [](auto&, auto&& args)
+    {
+      char* end;
+      auto sec = std::strtoul(args.front(), &end, 10);
+      if (*end != '\0') throw InvalidParam{"Invalid interval"};
+      SetThrowStatsLogInterval(std::chrono::seconds(sec));
+    }};
+
+  TEST_CASE("throw stats")
+  {
+    auto old_enabled = ThrowSite::IsEnabled();
+    AtScopeExit x{[&]() { ThrowSite::SetEnabled(old_enabled); }};
+    ThrowSite::SetEnabled(true);
+    ResetThrowStats();
+
+    auto thrower = [](int i)
+    {
+      if (i % 2) LIBSHIT_THROW(std::runtime_error, "odd");
+      LIBSHIT_THROW(std::runtime_error, "even");
+    };
+    for (int i = 0; i < 5; ++i)
+      try { thrower(i); } catch (const std::runtime_error&) {}
+
+    auto stats = GetThrowStats();
+    REQUIRE(stats.size() == 2);
+    CHECK(stats[0].count == 3);
+    CHECK(stats[1].count == 2);
+    CHECK(stats[0].line == stats[1].line + 1);
+    CHECK(std::strstr(stats[0].file, "except.cpp"));
+    CHECK(stats[0].func);
+
+    ThrowSite::SetEnabled(false);
+    try { thrower(0); } catch (const std::runtime_error&) {}
+    CHECK(GetThrowStats()[1].count == 2);
+
+    ResetThrowStats();
+    CHECK(GetThrowStats().empty());
+
+    // still a throw-expression
+    ThrowSite::SetEnabled(true);
+    auto nonzero = [](int i)
+    { return i ? i : LIBSHIT_THROW(std::runtime_error, "zero"); };
+    CHECK(nonzero(3) == 3);
+    CHECK_THROWS_AS(nonzero(0), std::runtime_error);
+    REQUIRE(GetThrowStats().size() == 1);
+    CHECK(GetThrowStats()[0].count == 1);
+  }
+#endif
+
   void RethrowException()
   {
     try { throw; }
@@ -293,7 +713,9 @@ namespace Libshit
     if (msg)
       log << "\033[1mMessage\033[22m: " << msg << "\033[0m\n";
 
-    PrintStacktrace(log, boost::stacktrace::stacktrace{}, true);
+    void* frames[EXCEPTION_MAX_FRAMES];
+    auto n = CaptureStacktrace(frames, EXCEPTION_MAX_FRAMES);
+    PrintStacktrace(log, frames, n, true);
     log.flush();
 
     std::abort();
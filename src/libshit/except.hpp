@@ -5,21 +5,36 @@
 #include "libshit/utils.hpp"
 
 #include "libshit/platform.hpp"
+#include "libshit/to_chars.hpp"
 
+#include <boost/config.hpp>
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 
+#include <atomic>
 #include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #define LIBSHIT_EXCEPTION_WITH_SOURCE_LOCATION LIBSHIT_IS_DEBUG
 
-#if LIBSHIT_EXCEPTION_WITH_SOURCE_LOCATION
+// count LIBSHIT_THROWs per throw site, see ThrowSite. Stores the file name and
+// function name of every throw site, so off by default in release builds:
+// configure with `--exception-stats` to enable it there too.
+#ifndef LIBSHIT_EXCEPTION_STATS
+#  define LIBSHIT_EXCEPTION_STATS LIBSHIT_EXCEPTION_WITH_SOURCE_LOCATION
+#endif
+
+#if LIBSHIT_EXCEPTION_WITH_SOURCE_LOCATION || LIBSHIT_EXCEPTION_STATS
 #  include "libshit/file.hpp" // IWYU pragma: export
 #endif
 
@@ -29,21 +44,42 @@ namespace Libshit
   void intrusive_ptr_add_ref(ExceptionInfo* ptr);
   void intrusive_ptr_release(ExceptionInfo* ptr);
 
+  /**
+   * Convert anything printable to a string. Formatting is the same as Cat:
+   * floating point numbers use the shortest representation that round-trips
+   * (not the fixed 6 decimals of std::to_string), `char` is a character,
+   * other integers are numbers.
+   */
   template <typename T>
   decltype(std::declval<std::ostream>() << std::declval<T>(), std::string{})
   inline ToString(const T& t)
   {
-    std::stringstream ss;
-    ss << t;
-    return ss.str();
+    if constexpr (HAS_TO_CHARS<T>)
+    {
+      std::string res;
+      FormatTo(res, t);
+      return res;
+    }
+    else
+    {
+      std::stringstream ss;
+      ss << t;
+      return ss.str();
+    }
   }
 
   inline std::string ToString(std::string s) noexcept { return s; }
   inline std::string ToString(const char* s) { return s; }
-
-#define LIBSHIT_GEN(type) \
-  inline std::string ToString(type t) { return std::to_string(t); }
-  LIBSHIT_GEN(char)  LIBSHIT_GEN(unsigned char) LIBSHIT_GEN(signed char)
+  inline std::string ToString(char c) { return std::string(1, c); }
+
+#define LIBSHIT_GEN(type)                       \
+  inline std::string ToString(type t)           \
+  {                                             \
+    std::string res;                            \
+    FormatTo(res, t);                           \
+    return res;                                 \
+  }
+  LIBSHIT_GEN(unsigned char) LIBSHIT_GEN(signed char)
   LIBSHIT_GEN(short) LIBSHIT_GEN(unsigned short)
   LIBSHIT_GEN(int)   LIBSHIT_GEN(unsigned int)
   LIBSHIT_GEN(long)  LIBSHIT_GEN(unsigned long)
@@ -51,24 +87,123 @@ namespace Libshit
   LIBSHIT_GEN(float) LIBSHIT_GEN(double) LIBSHIT_GEN(long double)
 #undef LIBSHIT_GEN
 
+  /**
+   * Key of an exception info entry. Keys are copied (short ones fit into the
+   * small string buffer), except when wrapped into a StaticKey.
+   */
+  class ExceptionInfoKey
+  {
+  public:
+    /// A string that outlives every exception (like a string literal), only
+    /// the pointer is stored.
+    struct StaticKey { const char* str; };
+
+    ExceptionInfoKey() noexcept = default;
+    ExceptionInfoKey(StaticKey k) noexcept : ptr{k.str} {}
+    template <typename T, typename = std::enable_if_t<
+      !std::is_same_v<std::decay_t<T>, ExceptionInfoKey> &&
+      !std::is_same_v<std::decay_t<T>, StaticKey>>>
+    ExceptionInfoKey(T&& t) : ptr{nullptr}
+    {
+      if constexpr (std::is_array_v<std::remove_reference_t<T>>)
+        str = std::string_view(t);
+      else
+        str = std::forward<T>(t);
+    }
+
+    ExceptionInfoKey(ExceptionInfoKey&& o) noexcept
+      : ptr{o.ptr}, str{Move(o.str)} {}
+    ExceptionInfoKey& operator=(ExceptionInfoKey&& o) noexcept
+    { ptr = o.ptr; str = Move(o.str); return *this; }
+
+    const char* Get() const noexcept { return ptr ? ptr : str.c_str(); }
+
+  private:
+    const char* ptr = "";
+    std::string str;
+  };
+
+  /**
+   * Value of an exception info entry. Numbers are stored as is and only
+   * formatted when the exception is printed, strings (and `char`) are
+   * moved/copied.
+   * `const char` arrays are copied too, they are not necessarily literals
+   * (and the value often comes from a local buffer). Other types are
+   * converted with ToString immediately, as they might not outlive the
+   * exception.
+   */
+  class ExceptionInfoValue
+  {
+  public:
+    ExceptionInfoValue() noexcept = default;
+    template <typename T, typename = std::enable_if_t<
+      !std::is_same_v<std::decay_t<T>, ExceptionInfoValue>>>
+    ExceptionInfoValue(T&& t)
+    {
+      using U = std::remove_cv_t<std::remove_reference_t<T>>;
+      if constexpr (std::is_same_v<U, std::string>)
+      { kind = Kind::STRING; str = std::forward<T>(t); }
+      else if constexpr (std::is_same_v<U, char>)
+      { kind = Kind::STRING; str.assign(1, t); }
+      else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+      { kind = Kind::SIGNED; u.sll = t; }
+      else if constexpr (std::is_integral_v<U>)
+      { kind = Kind::UNSIGNED; u.ull = t; }
+      else if constexpr (std::is_same_v<U, float>)
+      { kind = Kind::FLOAT; u.f = t; }
+      else if constexpr (std::is_same_v<U, double>)
+      { kind = Kind::DOUBLE; u.d = t; }
+      else if constexpr (std::is_same_v<U, long double>)
+      { kind = Kind::LONG_DOUBLE; u.ld = t; }
+      else if constexpr (std::is_convertible_v<const U&, std::string_view>)
+      {
+        kind = Kind::STRING;
+        str = std::string_view(t);
+      }
+      else
+      { kind = Kind::STRING; str = ToString(t); }
+    }
+
+    ExceptionInfoValue(ExceptionInfoValue&& o) noexcept
+      : kind{o.kind}, u{o.u}, str{Move(o.str)} {}
+    ExceptionInfoValue& operator=(ExceptionInfoValue&& o) noexcept
+    { kind = o.kind; u = o.u; str = Move(o.str); return *this; }
+
+    void Print(std::ostream& os) const;
+    std::string Format() const;
+
+  private:
+    static constexpr std::size_t NUMBER_BUF_SIZE = 64;
+    std::size_t FormatNumber(char (&buf)[NUMBER_BUF_SIZE]) const noexcept;
+
+    enum class Kind : unsigned char
+    { STRING, SIGNED, UNSIGNED, FLOAT, DOUBLE, LONG_DOUBLE };
+    Kind kind = Kind::STRING;
+    union
+    {
+      long long sll = 0;
+      unsigned long long ull;
+      float f;
+      double d;
+      long double ld;
+    } u;
+    std::string str;
+  };
+
   class Exception
   {
   public:
     virtual ~Exception() noexcept = default;
 
-    void AddInfo(std::string key, std::string value);
+    void AddInfo(ExceptionInfoKey key, ExceptionInfoValue value);
     void AddLocation(const char* file, unsigned line, const char* func);
 
     void PrintDesc(std::ostream& os, bool color) const;
 
-    template <typename T>
-    void AddInfo(std::string key, const T& value)
-    { AddInfo(Move(key), ToString(value)); }
-
     std::string operator[](const std::string& s) const;
 
   private:
-    void EnsureInfo();
+    void EnsureInfo(bool add_entry);
     boost::intrusive_ptr<ExceptionInfo> info;
   };
 
@@ -133,8 +268,90 @@ namespace Libshit
   ::Libshit::GetException<type>(nullptr, 0, nullptr, __VA_ARGS__)
 #endif
 
-#define LIBSHIT_THROW(type, ...) \
+#if LIBSHIT_EXCEPTION_STATS
+  struct ThrowStat;
+
+  /**
+   * Throw counter of a single LIBSHIT_THROW. They're created lazily (on the
+   * first throw after stats were enabled) as function local statics, so
+   * counting is just an atomic increment without any lookup.
+   */
+  class ThrowSite
+  {
+  public:
+    ThrowSite(const char* file, unsigned line) noexcept;
+    ThrowSite(const ThrowSite&) = delete;
+    void operator=(const ThrowSite&) = delete;
+
+    template <typename GetSite>
+    static void Hit(GetSite get_site, const char* func) noexcept
+    {
+      if (BOOST_UNLIKELY(enabled.load(std::memory_order_relaxed)))
+        get_site().Add(func);
+    }
+
+    void Add(const char* func) noexcept;
+
+    static void SetEnabled(bool en) noexcept
+    { enabled.store(en, std::memory_order_relaxed); }
+    static bool IsEnabled() noexcept
+    { return enabled.load(std::memory_order_relaxed); }
+
+  private:
+    friend std::vector<ThrowStat> GetThrowStats();
+    friend void ResetThrowStats() noexcept;
+
+    static std::atomic<bool> enabled;
+
+    const char* const file;
+    const unsigned line;
+    std::atomic<const char*> func{nullptr};
+    std::atomic<std::uint64_t> count{0};
+    ThrowSite* next;
+  };
+
+  struct ThrowStat
+  {
+    const char* file;
+    unsigned line;
+    const char* func;
+    std::uint64_t count;
+  };
+
+  /// Get throw counts of every LIBSHIT_THROW fired since stats were enabled,
+  /// sorted by decreasing count.
+  std::vector<ThrowStat> GetThrowStats();
+  void ResetThrowStats() noexcept;
+  void DumpThrowStats(std::ostream& os);
+  /**
+   * Log throw stats every `interval` (checked when something is thrown, so
+   * there's no background thread), and at exit. Zero interval means only at
+   * exit. Also enables stats. Set by `--exception-stats`.
+   */
+  void SetThrowStatsLogInterval(std::chrono::seconds interval) noexcept;
+
+// count inside the operand of throw, so this remains a throw-expression
+// (usable in `a ? b : LIBSHIT_THROW(...)`)
+#  define LIBSHIT_THROW(type, ...)                                        \
+  (throw (::Libshit::ThrowSite::Hit([]() -> ::Libshit::ThrowSite& {       \
+      static ::Libshit::ThrowSite site{LIBSHIT_FILE, __LINE__};           \
+      return site; }, LIBSHIT_FUNCTION),                                  \
+    LIBSHIT_GET_EXCEPTION(type, __VA_ARGS__)))
+#else
+#  define LIBSHIT_THROW(type, ...) \
   (throw LIBSHIT_GET_EXCEPTION(type, __VA_ARGS__))
+#endif
+
+  /// Maximal number of stack frames stored in an exception.
+  inline constexpr std::size_t EXCEPTION_MAX_FRAMES = 32;
+  /**
+   * Set how many stack frames are recorded when an exception is created (0
+   * disables). Only return addresses are stored, they're symbolized when the
+   * exception is printed. Defaults to EXCEPTION_MAX_FRAMES in debug builds and
+   * 0 otherwise, can be also set with `--exception-stacktrace`.
+   */
+  void SetExceptionStacktraceDepth(std::size_t depth) noexcept;
+  std::size_t GetExceptionStacktraceDepth() noexcept;
 
   [[noreturn]] void RethrowException();
   std::string ExceptionToString(bool color);
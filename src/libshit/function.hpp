@@ -7,6 +7,7 @@
 
 #include <cstddef>
 #include <functional>
+#include <memory>
 #include <new>
 #include <type_traits>
 #include <utility>
@@ -26,9 +27,20 @@ namespace Libshit
   template <auto Fun>
   constexpr const inline Func<Fun> FUNC;
 
+  namespace Detail
+  {
+    template <typename T, size_t Size>
+    inline constexpr bool FUNCTION_FITS_INLINE =
+      sizeof(T) <= Size &&
+      alignof(T) <= alignof(std::aligned_storage_t<Size>) &&
+      std::is_nothrow_move_constructible_v<T>;
+  }
+
   /**
    * Like std::function, but only movable. Implements const qualified signature
-   * from P0045R1, e.g. `Function<void (int) const>`.
+   * from P0045R1, e.g. `Function<void (int) const>`. Function objects that
+   * don't fit into `Size` bytes (or can throw when moved) are heap allocated,
+   * optionally with a user supplied allocator.
    * @see Function
    */
   template <size_t Size, bool IsConst, typename Ret, typename... Args>
@@ -62,6 +74,21 @@ namespace Libshit
       : vptr{&static_vptr<T>}
     { VptrImpl<T>::Construct(&buf, std::forward<CArgs>(args)...); }
 
+    /**
+     * Allocate the function object with `alloc` (for example from an arena)
+     * if it doesn't fit into the inline buffer. `alloc` must return plain
+     * pointers, and it's copied next to the function object.
+     */
+    template <typename Alloc, typename T>
+    FunctionImpl(std::allocator_arg_t, const Alloc& alloc, T t)
+      : vptr{&static_alloc_vptr<T, Alloc>}
+    { AllocVptr<T, Alloc>::Construct(&buf, alloc, Move(t)); }
+
+    /// Whether a function object of type `T` is stored in the inline buffer
+    /// (without allocation).
+    template <typename T>
+    static constexpr bool IS_INLINE = Detail::FUNCTION_FITS_INLINE<T, Size>;
+
     void reset() noexcept
     {
       if (!vptr) return;
@@ -87,6 +114,9 @@ namespace Libshit
 
   private:
     using VoidPtr = std::conditional_t<IsConst, const void*, void*>;
+    template <typename T>
+    static constexpr bool FitsInline() noexcept
+    { return Detail::FUNCTION_FITS_INLINE<T, Size>; }
 
     struct Vptr
     {
@@ -123,9 +153,7 @@ namespace Libshit
     };
 
     template <typename T>
-    /* todo check align */
-    struct VptrImpl<T, std::enable_if_t<
-      sizeof(T) <= Size && std::is_nothrow_move_constructible_v<T>>> : Vptr
+    struct VptrImpl<T, std::enable_if_t<FitsInline<T>()>> : Vptr
     {
       using TPtr = std::conditional_t<IsConst, const T*, T*>;
       constexpr VptrImpl() : Vptr{
@@ -143,7 +171,83 @@ namespace Libshit
       { new (buf) T(std::forward<CArgs>(args)...); }
     };
 
+    template <typename T, typename Alloc>
+    struct AllocNode
+    {
+      template <typename... CArgs>
+      AllocNode(const Alloc& alloc, CArgs&&... args)
+        : alloc{alloc}, t(std::forward<CArgs>(args)...) {}
+
+      Alloc alloc;
+      T t;
+    };
+
+    template <typename T, typename Alloc, typename = void>
+    struct AllocVptrImpl : Vptr
+    {
+      using Node = AllocNode<T, Alloc>;
+      using NodeAlloc = typename std::allocator_traits<Alloc>::
+        template rebind_alloc<Node>;
+      using Traits = std::allocator_traits<NodeAlloc>;
+      static_assert(std::is_same_v<typename Traits::pointer, Node*>,
+                    "Fancy pointers not supported");
+      static_assert(sizeof(Node*) <= Size);
+      using NPPtr = std::conditional_t<IsConst, Node const* const*, Node**>;
+
+      constexpr AllocVptrImpl() : Vptr{
+        [](VoidPtr buf, Args&&... args) -> Ret
+        {
+          auto n = *static_cast<NPPtr>(buf);
+          LIBSHIT_ASSERT_MSG(n, "Called moved out Function");
+          return std::invoke(n->t, std::forward<Args>(args)...);
+        },
+        [](void* buf) noexcept
+        {
+          auto n = *static_cast<Node**>(buf);
+          if (!n) return;
+          NodeAlloc alloc{n->alloc};
+          n->~Node();
+          Traits::deallocate(alloc, n, 1);
+        },
+        [](void* new_buf, void* old_buf) noexcept
+        {
+          Node** new_n = static_cast<Node**>(new_buf);
+          Node** old_n = static_cast<Node**>(old_buf);
+          *new_n = *old_n;
+          *old_n = nullptr;
+        }} {}
+
+      template <typename... CArgs>
+      static void Construct(void* buf, const Alloc& alloc, CArgs&&... args)
+      {
+        NodeAlloc nalloc{alloc};
+        auto n = Traits::allocate(nalloc, 1);
+        try { new (n) Node(alloc, std::forward<CArgs>(args)...); }
+        catch (...)
+        {
+          Traits::deallocate(nalloc, n, 1);
+          throw;
+        }
+        *static_cast<Node**>(buf) = n;
+      }
+    };
+
+    // small function objects are still stored inline
+    template <typename T, typename Alloc>
+    struct AllocVptrImpl<T, Alloc, std::enable_if_t<FitsInline<T>()>>
+      : VptrImpl<T>
+    {
+      template <typename... CArgs>
+      static void Construct(void* buf, const Alloc&, CArgs&&... args)
+      { VptrImpl<T>::Construct(buf, std::forward<CArgs>(args)...); }
+    };
+
+    template <typename T, typename Alloc>
+    using AllocVptr = AllocVptrImpl<T, Alloc>;
+
     template <typename T> constexpr inline static VptrImpl<T> static_vptr{};
+    template <typename T, typename Alloc>
+    constexpr inline static AllocVptr<T, Alloc> static_alloc_vptr{};
 
     std::aligned_storage_t<Size> buf;
     const Vptr* vptr = nullptr;
@@ -167,6 +271,63 @@ namespace Libshit
   template <typename T, size_t Size = 3*sizeof(void*)>
   using Function = typename FunctionT<T, Size>::type;
 
+  template <typename T> class FunctionView;
+
+  /**
+   * Non-owning reference to a callable, like `function_ref` from P0792. It
+   * never allocates and calling it is a single indirect call, but the
+   * referenced callable must outlive the view, so only use it for callbacks
+   * that are not stored (passing a lambda directly to a function taking a
+   * FunctionView is fine).
+   */
+  template <typename Ret, typename... Args>
+  class FunctionView<Ret (Args...)>
+  {
+  public:
+    template <typename T, typename = std::enable_if_t<
+      !std::is_same_v<std::decay_t<T>, FunctionView> &&
+      std::is_invocable_r_v<Ret, T&, Args...>>>
+    FunctionView(T&& t) noexcept
+    {
+      if constexpr (std::is_function_v<std::remove_pointer_t<
+                      std::remove_reference_t<T>>>)
+      {
+        using FunPtr = std::decay_t<T>;
+        if constexpr (std::is_pointer_v<std::remove_reference_t<T>>)
+          LIBSHIT_ASSERT(t);
+        obj.fun = reinterpret_cast<void (*)()>(static_cast<FunPtr>(t));
+        call = [](Obj o, Args&&... args) -> Ret
+        {
+          return std::invoke(reinterpret_cast<FunPtr>(o.fun),
+                             std::forward<Args>(args)...);
+        };
+      }
+      else
+      {
+        using U = std::remove_reference_t<T>;
+        obj.ptr = const_cast<void*>(
+          static_cast<const void*>(std::addressof(t)));
+        call = [](Obj o, Args&&... args) -> Ret
+        {
+          return std::invoke(
+            *static_cast<U*>(o.ptr), std::forward<Args>(args)...);
+        };
+      }
+    }
+
+    Ret operator()(Args... args) const
+    { return call(obj, std::forward<Args>(args)...); }
+
+  private:
+    union Obj
+    {
+      void* ptr;
+      void (*fun)();
+    };
+    Obj obj;
+    Ret (*call)(Obj, Args&&...);
+  };
+
 }
 
 #endif
@@ -12,6 +12,7 @@
 #include "libshit/lua/function_call.hpp"
 #include "libshit/nonowning_string.hpp"
 #include "libshit/options.hpp"
+#include "libshit/startup_trace.hpp"
 #include "libshit/string_utils.hpp"
 #include "libshit/utils.hpp"
 
@@ -102,6 +103,7 @@ namespace Libshit::Logger
     GlobalInitializer::GlobalInitializer()
     {
       if (global_refcount++ != 0) return;
+      StartupTrace::Scope trace{"logger", "global init"};
       new (&global_storage) Global;
     }
     GlobalInitializer::~GlobalInitializer() noexcept
@@ -550,7 +552,11 @@ namespace Libshit::Logger
       std::ostream log_os{&filter};
     };
 
-    PerThreadInitializer::PerThreadInitializer() { pimpl = new PerThread; }
+    PerThreadInitializer::PerThreadInitializer()
+    {
+      StartupTrace::Scope trace{"logger", "per thread init"};
+      pimpl = new PerThread;
+    }
     PerThreadInitializer::~PerThreadInitializer() noexcept
     { delete pimpl; pimpl = nullptr; }
   }
@@ -626,7 +632,7 @@ namespace Libshit::Logger
       lua_pop(vm, 1); // 0
 
       LIBSHIT_LUA_RUNBC(vm, logger, 0);
-    }};
+    }, "libshit.log"};
 
 #endif
 }
@@ -121,6 +121,22 @@ namespace Libshit
     return size.QuadPart;
   }
 
+  std::uint64_t LowIo::GetModificationTime() const
+  {
+    FILETIME time;
+    if (!GetFileTime(fd, nullptr, nullptr, &time))
+      LIBSHIT_THROW_WINERROR("GetFileTime");
+    return (std::uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+  }
+
+  std::uint64_t LowIo::GetFileId() const
+  {
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!GetFileInformationByHandle(fd, &info))
+      LIBSHIT_THROW_WINERROR("GetFileInformationByHandle");
+    return (std::uint64_t(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+  }
+
   void LowIo::Truncate(FilePosition size) const
   {
     LARGE_INTEGER zero{};
@@ -199,6 +215,18 @@ namespace Libshit
       LIBSHIT_THROW_WINERROR("ReadFile");
   }
 
+  std::size_t LowIo::ReadSome(void* buf, std::size_t len) const
+  {
+    DWORD size;
+    if (!ReadFile(fd, buf, len, &size, nullptr))
+    {
+      // write end of a pipe closed
+      if (GetLastError() == ERROR_BROKEN_PIPE) return 0;
+      LIBSHIT_THROW_WINERROR("ReadFile");
+    }
+    return size;
+  }
+
   void LowIo::Pwrite(const void* buf, std::size_t len, FilePosition offs) const
   {
     DWORD size;
@@ -294,6 +322,28 @@ namespace Libshit
     return buf.st_size;
   }
 
+  std::uint64_t LowIo::GetModificationTime() const
+  {
+    struct stat buf;
+    if (fstat(fd, &buf) < 0) LIBSHIT_THROW_ERRNO("fstat");
+#if LIBSHIT_OS_IS_LINUX
+    return std::uint64_t(buf.st_mtim.tv_sec) * 1000000000 + buf.st_mtim.tv_nsec;
+#else
+    return buf.st_mtime;
+#endif
+  }
+
+  std::uint64_t LowIo::GetFileId() const
+  {
+#if LIBSHIT_OS_IS_VITA
+    return 0;
+#else
+    struct stat buf;
+    if (fstat(fd, &buf) < 0) LIBSHIT_THROW_ERRNO("fstat");
+    return buf.st_ino;
+#endif
+  }
+
   void LowIo::Truncate(FilePosition size) const
   {
     if (ftruncate(fd, size) < 0) LIBSHIT_THROW_ERRNO("ftruncate");
@@ -358,6 +408,13 @@ namespace Libshit
     if (read(fd, buf, len) != len) LIBSHIT_THROW_ERRNO("read");
   }
 
+  std::size_t LowIo::ReadSome(void* buf, std::size_t len) const
+  {
+    auto res = read(fd, buf, len);
+    if (res < 0) LIBSHIT_THROW_ERRNO("read");
+    return res;
+  }
+
   void LowIo::Pwrite(const void* buf, std::size_t len, FilePosition offs) const
   {
     if (pwrite(fd, buf, len, offs) != len) LIBSHIT_THROW_ERRNO("pwrite");
@@ -124,6 +124,12 @@ namespace Libshit
     static constexpr const bool MMAP_SUPPORTED = !LIBSHIT_OS_IS_VITA;
 
     FilePosition GetSize() const;
+    /// Last modification time in an unspecified unit, only useful to check
+    /// whether the file changed.
+    std::uint64_t GetModificationTime() const;
+    /// Number that identifies the file on its file system (inode number), 0
+    /// if not supported.
+    std::uint64_t GetFileId() const;
     void Truncate(FilePosition size) const;
     void PrepareMmap(bool write);
     MmapPtr Mmap(FilePosition offs, std::size_t size, bool write) const;
@@ -131,6 +137,9 @@ namespace Libshit
 
     void Pread(void* buf, std::size_t len, FilePosition offs) const;
     void Read(void* buf, std::size_t len) const;
+    /// Read at most `len` bytes, return the number of bytes read (0 at EOF).
+    /// Works on pipes too.
+    std::size_t ReadSome(void* buf, std::size_t len) const;
 
     void Pwrite(const void* buf, std::size_t len, FilePosition offs) const;
     void Write(const void* buf, std::size_t len) const;
@@ -60,7 +60,7 @@ namespace Libshit::Lua
           return GET_TABLE_CTOR<T>(vm, aidx); // +1
         else
         {
-          auto t = lua_rawgetp(vm, LUA_REGISTRYINDEX, TypeTraits<T>::TAG + 1); // +1
+          auto t = GetRegisteredType(vm, TypeTraits<T>::TAG + 1); // +1
           LIBSHIT_ASSERT(t == LUA_TTABLE); (void) t;
           auto n = vm.Unpack01(aidx); // +1+n
           lua_call(vm, n, 1); // +1
@@ -25,6 +25,7 @@ namespace Libshit::Lua
 {
   TEST_SUITE_BEGIN("Libshit::Lua::State");
   char reftbl;
+  char lazytbl;
 
   State::State(int) : StateRef{luaL_newstate()}
   {
@@ -252,14 +253,21 @@ assert(typename(stuff_ud) == "userdata")
         lua_setmetatable(vm, -2);       // +1
         lua_rawsetp(vm, LUA_REGISTRYINDEX, &reftbl); // 0
 
+        // types registered but not initialized yet
+        lua_newtable(vm); // +1
+        lua_rawsetp(vm, LUA_REGISTRYINDEX, &lazytbl); // 0
+
         // helper funs
         LIBSHIT_LUA_RUNBC(vm, base_funcs, 0);
 #if LIBSHIT_WITH_TRACY
         tracy::LuaRegister(vm);
 #endif
 
-        for (auto r : Registers())
-          r(vm);
+        for (auto [fun, name] : Registers())
+        {
+          StartupTrace::Scope trace{"lua register", name};
+          fun(vm);
+        }
 
         LIBSHIT_LUA_CHECKTOP(vm, top);
       }, *this);
@@ -270,6 +278,29 @@ assert(typename(stuff_ud) == "userdata")
     if (vm) lua_close(vm);
   }
 
+  int GetRegisteredType(StateRef vm, const char* key)
+  {
+    auto top = lua_gettop(vm);
+    auto type = lua_rawgetp(vm, LUA_REGISTRYINDEX, key); // +1
+    if (!IsNoneOrNil(type)) return type;
+    lua_pop(vm, 1); // 0
+
+    // lazytbl[key] is a stub table, stub[&lazytbl] is the init function
+    if (lua_rawgetp(vm, LUA_REGISTRYINDEX, &lazytbl) == LUA_TTABLE && // +1
+        lua_rawgetp(vm, -1, key) == LUA_TTABLE &&                    // +2
+        lua_rawgetp(vm, -1, &lazytbl) == LUA_TFUNCTION)              // +3
+    {
+      lua_call(vm, 0, 0); // +2
+      lua_pop(vm, 2); // 0
+    }
+    else
+      lua_settop(vm, top); // 0
+
+    type = lua_rawgetp(vm, LUA_REGISTRYINDEX, key); // +1
+    LIBSHIT_LUA_CHECKTOP(vm, top+1);
+    return type;
+  }
+
 #if LIBSHIT_LUA_SEH_HANDLING
   int StateRef::SEHFilter(lua_State* vm, unsigned code,
                           const char** error_msg, std::size_t* error_len)
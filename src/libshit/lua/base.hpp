@@ -7,6 +7,7 @@
 #include "libshit/assert.hpp"
 #include "libshit/except.hpp"
 #include "libshit/platform.hpp"
+#include "libshit/startup_trace.hpp"
 #include "libshit/utils.hpp"
 
 #include <cstring> /* strstr */ // IWYU pragma: keep
@@ -36,7 +37,13 @@
 #  define LIBSHIT_LUA_CHECKTOP(vm, val) ((void) 0)
 #endif
 
-#if LIBSHIT_OS_IS_WINDOWS && (defined(LUA_VERSION_LJX) || defined(LUAJIT_VERSION))
+#if defined(LUA_VERSION_LJX) || defined(LUAJIT_VERSION)
+#  define LIBSHIT_LUA_HAS_FFI 1
+#else
+#  define LIBSHIT_LUA_HAS_FFI 0
+#endif
+
+#if LIBSHIT_OS_IS_WINDOWS && LIBSHIT_LUA_HAS_FFI
 #  define LIBSHIT_LUA_SEH_HANDLING 1
 #else
 #  define LIBSHIT_LUA_SEH_HANDLING 0
@@ -48,6 +55,7 @@ namespace Libshit::Lua
   template <typename T, typename Enable = void>
   struct TypeTraits; // IWYU pragma: keep
   extern char reftbl;
+  extern char lazytbl;
 
   LIBSHIT_GEN_EXCEPTION_TYPE(Error, std::runtime_error);
 
@@ -223,6 +231,13 @@ namespace Libshit::Lua
 #endif
   };
 
+  /**
+   * Push registry[key], where key is a type's metatable or type table key
+   * (TYPE_NAME or TYPE_NAME+1). If the type was registered lazily and it's not
+   * initialized yet, initialize it first. Returns the type of the pushed value.
+   */
+  int GetRegisteredType(StateRef vm, const char* key);
+
 #define LIBSHIT_LUA_RUNBC(vm, name, retnum)                  \
   do                                                         \
   {                                                          \
@@ -246,13 +261,18 @@ namespace Libshit::Lua
   private:
     static auto& Registers()
     {
-      static std::vector<RegisterFun> registers;
+      static std::vector<std::pair<RegisterFun, const char*>> registers;
       return registers;
     }
   public:
     struct Register
     {
-      Register(RegisterFun fun) { Registers().push_back(fun); }
+      /// `name` is only used for StartupTrace.
+      Register(RegisterFun fun, const char* name = nullptr)
+      {
+        Registers().emplace_back(fun, name);
+        StartupTrace::Mark("lua register", name);
+      }
     };
   };
 }
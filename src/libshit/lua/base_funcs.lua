@@ -65,6 +65,18 @@ function reg.libshit_ipairs(container)
   return cb, container, -1
 end
 
+-- cast lightuserdata pointers to ffi cdata, ctypes are parsed only once
+local has_ffi, ffi = pcall(require, "ffi")
+if has_ffi then
+  local cast, typeof = ffi.cast, ffi.typeof
+  local ctypes = setmetatable({}, {__index = function(t, k)
+    local v = typeof(k)
+    t[k] = v
+    return v
+  end})
+  function reg.libshit_ffi_cast(ctype, ptr) return cast(ctypes[ctype], ptr) end
+end
+
 -- like type() but checks metatable for __name
 function typename(t)
   local mt = getmetatable(t)
@@ -5,6 +5,7 @@
 #if LIBSHIT_WITH_LUA
 
 #include "libshit/lua/function_call_types.hpp" // IWYU pragma: export
+#include "libshit/lua/profile.hpp"
 #include "libshit/lua/type_traits.hpp"
 #include "libshit/meta_utils.hpp" // IWYU pragma: keep
 
@@ -246,31 +247,78 @@ namespace Libshit::Lua
       catch (const std::exception& e) { vm.ToLuaException(); }
     }
 
+    // get the arguments first, so their conversion can be measured, and push
+    // the result while the arguments are still alive (it can be a reference
+    // into them)
+    template <auto Fun, bool Unsafe, typename Ret, typename... Args,
+              typename Prof>
+    int ProfiledInvoke(StateRef vm, Prof& prof)
+    {
+      std::tuple<decltype(GetArg<typename Args::ArgT>::template Get<Unsafe>(
+                            vm, Args::Idx))...> args{
+        GetArg<typename Args::ArgT>::template Get<Unsafe>(vm, Args::Idx)...};
+      prof.ArgsDone();
+      return std::apply([&](auto&&... as)
+      {
+        if constexpr (std::is_void_v<Ret>)
+        {
+          CatchInvoke(vm, Fun, std::forward<decltype(as)>(as)...);
+          return 0;
+        }
+        else
+        {
+          decltype(auto) ret =
+            CatchInvoke(vm, Fun, std::forward<decltype(as)>(as)...);
+          prof.ResultsStart();
+          return ResultPush<Ret>::Push(vm, std::forward<decltype(ret)>(ret));
+        }
+      }, Libshit::Move(args));
+    }
+
     template <auto Fun, bool Unsafe, typename Ret, typename Args>
     struct WrapFunGen;
 
     template <auto Fun, bool Unsafe, typename Ret, std::size_t N, typename... Args>
     struct WrapFunGen<Fun, Unsafe, Ret, ArgSeq<N, mp::mp_list<Args...>>>
     {
+      using ProfileTag = WrapFunGen;
+
       static int Func(lua_State* l)
       {
         StateRef vm{l};
-        return ResultPush<Ret>::Push(
-          vm, CatchInvoke(
-            vm, Fun, GetArg<typename Args::ArgT>::template Get<Unsafe>(
-              vm, Args::Idx)...));
+        if constexpr (Profile::ENABLED)
+        {
+          Profile::Scope<WrapFunGen> prof;
+          return ProfiledInvoke<Fun, Unsafe, Ret, Args...>(vm, prof);
+        }
+        else
+          return ResultPush<Ret>::Push(
+            vm, CatchInvoke(
+              vm, Fun, GetArg<typename Args::ArgT>::template Get<Unsafe>(
+                vm, Args::Idx)...));
       }
     };
 
     template <auto Fun, bool Unsafe, std::size_t N, typename... Args>
     struct WrapFunGen<Fun, Unsafe, void, ArgSeq<N, mp::mp_list<Args...>>>
     {
+      using ProfileTag = WrapFunGen;
+
       static int Func(lua_State* l)
       {
         StateRef vm{l};
-        CatchInvoke(vm, Fun, GetArg<typename Args::ArgT>::template Get<Unsafe>(
-                      vm, Args::Idx)...);
-        return 0;
+        if constexpr (Profile::ENABLED)
+        {
+          Profile::Scope<WrapFunGen> prof;
+          return ProfiledInvoke<Fun, Unsafe, void, Args...>(vm, prof);
+        }
+        else
+        {
+          CatchInvoke(
+            vm, Fun, GetArg<typename Args::ArgT>::template Get<Unsafe>(
+              vm, Args::Idx)...);
+          return 0;
+        }
       }
     };
 
@@ -306,9 +354,14 @@ namespace Libshit::Lua
     template <auto Fun, auto... Rest, typename Orig>
     struct OverloadWrap<AutoList<Fun, Rest...>, Orig>
     {
+      using ProfileTag = OverloadWrap;
+
       static int Func(lua_State* l)
       {
         StateRef vm{l};
+        // only measure the outermost level
+        [[maybe_unused]] Profile::Scope<
+          OverloadWrap, std::is_same_v<AutoList<Fun, Rest...>, Orig>> prof;
         if (OverloadCheck<ArgSequence<Fun>>::Is(vm))
           return WrapFunc<Fun, true>::Func(vm);
         else
@@ -361,6 +414,27 @@ namespace Libshit::Lua
     template <auto... Funs>
     using Overload = OverloadWrap<AutoList<Funs...>, AutoList<Funs...>>;
 
+#if LIBSHIT_LUA_PROFILE
+    template <typename T, typename Enable = void> struct ProfileName
+    { static void Set(const char*, const char*) {} };
+    template <typename T>
+    struct ProfileName<T, std::void_t<typename T::ProfileTag>>
+    {
+      static void Set(const char* type_name, const char* fun_name)
+      { Profile::COUNTER<typename T::ProfileTag>.SetName(type_name, fun_name); }
+    };
+
+    // individual overloads keep their default (signature based) name
+    template <auto... Funs>
+    void SetProfileName(const char* type_name, const char* fun_name)
+    {
+      if constexpr (sizeof...(Funs) == 1)
+        ProfileName<WrapFunc<Funs..., false>>::Set(type_name, fun_name);
+      else
+        ProfileName<Overload<Funs...>>::Set(type_name, fun_name);
+    }
+#endif
+
   }
 
   template <auto... Funs>
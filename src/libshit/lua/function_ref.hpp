@@ -3,6 +3,7 @@
 #pragma once
 
 #include "libshit/lua/base.hpp"
+#include "libshit/lua/profile.hpp"
 #include "libshit/lua/value.hpp"
 
 #include "libshit/assert.hpp"
@@ -28,12 +29,16 @@ namespace Libshit::Lua
     Ret Call(StateRef vm, Args&&... args)
     {
       LIBSHIT_LUA_GETTOP(vm, top);
+      struct ProfileTag;
+      Profile::Scope<ProfileTag> prof;
 
       fun.Push(vm);
       LIBSHIT_ASSERT(lua_type(vm, -1) == LUA_TFUNCTION);
       vm.PushAll(std::forward<Args>(args)...);
+      prof.ArgsDone();
       lua_call(vm, sizeof...(Args), 1);
 
+      prof.ResultsStart();
       auto ret = vm.Get<Ret>();
       lua_pop(vm, 1);
       LIBSHIT_LUA_CHECKTOP(vm, top);
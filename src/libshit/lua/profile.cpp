@@ -0,0 +1,174 @@
+#include "libshit/lua/profile.hpp"
+
+#if LIBSHIT_LUA_PROFILE
+
+#include "libshit/lua/function_call.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+
+#include "libshit/doctest.hpp"
+
+namespace Libshit::Lua::Profile
+{
+  TEST_SUITE_BEGIN("Libshit::Lua::Profile");
+
+  // counters are only ever added (they have static storage duration), so a
+  // lock-free list is enough
+  static std::atomic<Counter*> head{nullptr};
+
+  Counter::Counter(const char* fallback_name) noexcept
+    : fallback_name{fallback_name}, next{head.load(std::memory_order_relaxed)}
+  {
+    while (!head.compare_exchange_weak(
+             next, this, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  Counter::~Counter() noexcept { delete name.load(std::memory_order_relaxed); }
+
+  void Counter::SetName(const char* type_name, const char* fun_name)
+  {
+    if (name.load(std::memory_order_acquire)) return;
+    auto str = new std::string{type_name};
+    *str += '.';
+    *str += fun_name;
+
+    std::string* exp = nullptr;
+    if (!name.compare_exchange_strong(exp, str, std::memory_order_acq_rel))
+      delete str;
+  }
+
+  const char* Counter::GetName() const noexcept
+  {
+    auto n = name.load(std::memory_order_acquire);
+    return n ? n->c_str() : fallback_name;
+  }
+
+  std::vector<Entry> GetEntries()
+  {
+    std::vector<Entry> res;
+    for (auto c = head.load(std::memory_order_acquire); c; c = c->next)
+    {
+      auto calls = c->calls.load(std::memory_order_relaxed);
+      if (calls == 0) continue;
+      res.push_back({
+          c->GetName(), calls,
+          std::chrono::nanoseconds(c->total_ns.load(std::memory_order_relaxed)),
+          std::chrono::nanoseconds(c->args_ns.load(std::memory_order_relaxed))});
+    }
+    std::sort(res.begin(), res.end(), [](const Entry& a, const Entry& b)
+              { return a.total > b.total; });
+    return res;
+  }
+
+  void Reset() noexcept
+  {
+    for (auto c = head.load(std::memory_order_acquire); c; c = c->next)
+    {
+      c->calls.store(0, std::memory_order_relaxed);
+      c->total_ns.store(0, std::memory_order_relaxed);
+      c->args_ns.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void Dump(std::ostream& os)
+  {
+    auto flags = os.flags();
+    os << std::setw(10) << "calls" << std::setw(14) << "total ms"
+       << std::setw(14) << "conv ms" << "  name\n";
+    for (const auto& e : GetEntries())
+      os << std::setw(10) << e.calls
+         << std::setw(14) << std::fixed << std::setprecision(3)
+         << e.total.count() / 1e6
+         << std::setw(14) << e.args.count() / 1e6
+         << "  " << e.name << '\n';
+    os.flags(flags);
+  }
+
+  // lua interface
+  static RetNum LuaGet(StateRef vm)
+  {
+    auto entries = GetEntries();
+    lua_createtable(vm, entries.size(), 0); // +1
+    for (std::size_t i = 0; i < entries.size(); ++i)
+    {
+      const auto& e = entries[i];
+      lua_createtable(vm, 0, 4); // +2
+      vm.Push(e.name); // +3
+      lua_setfield(vm, -2, "name"); // +2
+      lua_pushinteger(vm, e.calls); // +3
+      lua_setfield(vm, -2, "calls"); // +2
+      lua_pushnumber(vm, e.total.count() / 1e9); // +3
+      lua_setfield(vm, -2, "total"); // +2
+      lua_pushnumber(vm, e.args.count() / 1e9); // +3
+      lua_setfield(vm, -2, "conv"); // +2
+      lua_rawseti(vm, -2, i+1); // +1
+    }
+    return 1;
+  }
+
+  static std::string LuaDump()
+  {
+    std::stringstream ss;
+    Dump(ss);
+    return ss.str();
+  }
+
+  static void Register(StateRef vm)
+  {
+    LIBSHIT_LUA_GETTOP(vm, top);
+    lua_createtable(vm, 0, 3); // +1
+    vm.PushFunction<&LuaGet>(); // +2
+    lua_setfield(vm, -2, "get"); // +1
+    vm.PushFunction<&Reset>(); // +2
+    lua_setfield(vm, -2, "reset"); // +1
+    vm.PushFunction<&LuaDump>(); // +2
+    lua_setfield(vm, -2, "dump"); // +1
+
+    lua_pushglobaltable(vm); // +2
+    vm.SetRecTable("libshit.prof", -2); // +1
+    lua_pop(vm, 1); // 0
+    LIBSHIT_LUA_CHECKTOP(vm, top);
+  }
+  static State::Register reg{&Register, "libshit.prof"};
+
+  namespace
+  {
+    struct Test
+    {
+      static int Add(int a, int b) noexcept { return a+b; }
+    };
+  }
+
+  TEST_CASE("counters")
+  {
+    State vm;
+    Reset();
+    vm.PushFunction<&Test::Add>();
+    lua_setglobal(vm, "add");
+
+    vm.DoString(R"(
+for i=1,100 do assert(add(i, 1) == i+1) end
+local found
+for _,e in ipairs(libshit.prof.get()) do
+  if e.calls == 100 then found = e end
+end
+assert(found and found.total >= found.conv)
+assert(type(libshit.prof.dump()) == "string")
+)");
+
+    bool found = false;
+    for (const auto& e : GetEntries())
+      if (e.calls == 100) { found = true; CHECK(e.total >= e.args); }
+    CHECK(found);
+
+    Reset();
+    CHECK(GetEntries().empty());
+  }
+
+  TEST_SUITE_END();
+}
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef UUID_52EEA02D_3296_4B8F_A7C4_EA707B543156
+#define UUID_52EEA02D_3296_4B8F_A7C4_EA707B543156
+#pragma once
+
+#ifndef LIBSHIT_LUA_PROFILE
+#  define LIBSHIT_LUA_PROFILE 0
+#endif
+
+#if LIBSHIT_LUA_PROFILE
+
+#include "libshit/file.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#if LIBSHIT_WITH_TRACY
+#  include <Tracy.hpp>
+#endif
+
+#endif
+
+/**
+ * Optional instrumentation of the lua <-> C++ boundary (bound functions and
+ * FunctionRef calls). Enable with LIBSHIT_LUA_PROFILE=1 (`--lua-profile` at
+ * configure time), otherwise Scope is an empty struct and everything compiles
+ * to nothing.
+ */
+namespace Libshit::Lua::Profile
+{
+  inline constexpr bool ENABLED = LIBSHIT_LUA_PROFILE;
+
+#if LIBSHIT_LUA_PROFILE
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry;
+
+  class Counter
+  {
+  public:
+    explicit Counter(const char* fallback_name) noexcept;
+    ~Counter() noexcept;
+    Counter(const Counter&) = delete;
+    void operator=(const Counter&) = delete;
+
+    /// Set a human readable name, like `type_name.fun_name`. Only the first
+    /// call has any effect.
+    void SetName(const char* type_name, const char* fun_name);
+    const char* GetName() const noexcept;
+
+    void Add(Clock::duration total, Clock::duration args) noexcept
+    {
+      calls.fetch_add(1, std::memory_order_relaxed);
+      total_ns.fetch_add(ToNs(total), std::memory_order_relaxed);
+      args_ns.fetch_add(ToNs(args), std::memory_order_relaxed);
+    }
+
+  private:
+    static std::uint64_t ToNs(Clock::duration d) noexcept
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    }
+
+    friend std::vector<Entry> GetEntries();
+    friend void Reset() noexcept;
+    const char* fallback_name;
+    std::atomic<std::string*> name{nullptr};
+    std::atomic<std::uint64_t> calls{0}, total_ns{0}, args_ns{0};
+    Counter* next;
+  };
+
+  template <typename Tag> const char* TagName() noexcept
+  { return LIBSHIT_FUNCTION; }
+
+  template <typename Tag> inline Counter COUNTER{TagName<Tag>()};
+
+#if LIBSHIT_WITH_TRACY
+  inline constexpr tracy::SourceLocationData TRACY_LOC{
+    nullptr, "lua binding", __FILE__, __LINE__, 0};
+#endif
+
+  /**
+   * Measure a call: everything between construction and destruction counts as
+   * total time, everything before ArgsDone() and after ResultsStart() as
+   * argument/result conversion time.
+   */
+  template <typename Tag, bool Active = true>
+  class Scope
+  {
+  public:
+    Scope() noexcept : start{Clock::now()}
+#if LIBSHIT_WITH_TRACY
+      , zone{&TRACY_LOC}
+#endif
+    {
+#if LIBSHIT_WITH_TRACY
+      auto name = COUNTER<Tag>.GetName();
+      zone.Name(name, std::char_traits<char>::length(name));
+#endif
+    }
+    Scope(const Scope&) = delete;
+    void operator=(const Scope&) = delete;
+    ~Scope() noexcept
+    {
+      auto end = Clock::now();
+      if (results_start != Clock::time_point{}) conv += end - results_start;
+      COUNTER<Tag>.Add(end - start, conv);
+    }
+
+    void ArgsDone() noexcept { conv += Clock::now() - start; }
+    void ResultsStart() noexcept { results_start = Clock::now(); }
+
+  private:
+    Clock::time_point start, results_start{};
+    Clock::duration conv{};
+#if LIBSHIT_WITH_TRACY
+    tracy::ScopedZone zone;
+#endif
+  };
+
+  template <typename Tag>
+  struct Scope<Tag, false>
+  {
+    void ArgsDone() noexcept {}
+    void ResultsStart() noexcept {}
+  };
+
+  struct Entry
+  {
+    std::string name;
+    std::uint64_t calls;
+    std::chrono::nanoseconds total, args;
+  };
+
+  /// Get a snapshot of all counters with at least one call, sorted by
+  /// decreasing total time.
+  std::vector<Entry> GetEntries();
+  void Reset() noexcept;
+  void Dump(std::ostream& os);
+
+#else
+  template <typename Tag, bool Active = true>
+  struct Scope
+  {
+    void ArgsDone() noexcept {}
+    void ResultsStart() noexcept {}
+  };
+#endif
+}
+
+#endif
@@ -0,0 +1,202 @@
+#include "libshit/lua/state_pool.hpp"
+
+#include <exception>
+
+#include "libshit/doctest.hpp"
+
+namespace Libshit::Lua
+{
+  TEST_SUITE_BEGIN("Libshit::Lua::StatePool");
+  static char snapshot_key;
+
+  static void SaveGlobals(StateRef vm)
+  {
+    LIBSHIT_LUA_GETTOP(vm, top);
+    lua_newtable(vm);         // +1
+    lua_pushglobaltable(vm);  // +2
+    lua_pushnil(vm);          // +3
+    while (lua_next(vm, -2))  // +4/+2
+    {
+      lua_pushvalue(vm, -2); // +5
+      lua_insert(vm, -2);    // +5
+      lua_rawset(vm, -5);    // +3
+    }
+    lua_pop(vm, 1);                                   // +1
+    lua_rawsetp(vm, LUA_REGISTRYINDEX, &snapshot_key); // 0
+    LIBSHIT_LUA_CHECKTOP(vm, top);
+  }
+
+  static void RestoreGlobals(StateRef vm)
+  {
+    lua_settop(vm, 0);
+    lua_pushglobaltable(vm);                           // +1
+    lua_rawgetp(vm, LUA_REGISTRYINDEX, &snapshot_key); // +2
+
+    // fix up existing keys (removing/overwriting existing fields is allowed
+    // during traversal, adding new ones is not)
+    lua_pushnil(vm);         // +3
+    while (lua_next(vm, 1))  // +4/+2
+    {
+      lua_pushvalue(vm, -2); // +5
+      lua_rawget(vm, 2);     // +5
+      if (!lua_rawequal(vm, -1, -2))
+      {
+        lua_pushvalue(vm, -3); // +6
+        lua_insert(vm, -2);    // +6
+        lua_rawset(vm, 1);     // +4
+      }
+      else
+        lua_pop(vm, 1);  // +4
+      lua_pop(vm, 1);    // +3
+    }
+
+    // add back removed keys
+    lua_pushnil(vm);         // +3
+    while (lua_next(vm, 2))  // +4/+2
+    {
+      lua_pushvalue(vm, -2); // +5
+      lua_rawget(vm, 1);     // +5
+      if (lua_isnil(vm, -1))
+      {
+        lua_pop(vm, 1);        // +4
+        lua_pushvalue(vm, -2); // +5
+        lua_insert(vm, -2);    // +5
+        lua_rawset(vm, 1);     // +3
+      }
+      else
+        lua_pop(vm, 2); // +3
+    }
+
+    lua_settop(vm, 0);
+    lua_gc(vm, LUA_GCCOLLECT, 0);
+  }
+
+  void StatePool::Handle::Reset() noexcept
+  {
+    if (pool) pool->Release(Libshit::Move(state));
+    pool = nullptr;
+    state.reset();
+  }
+
+  StatePool::StatePool(std::size_t prewarm) { Prewarm(prewarm); }
+  StatePool::~StatePool() noexcept = default;
+
+  std::unique_ptr<State> StatePool::Create()
+  {
+    auto start = std::chrono::steady_clock::now();
+    auto state = std::make_unique<State>();
+    state->TranslateException(SaveGlobals, *state);
+    auto dur = std::chrono::steady_clock::now() - start;
+
+    std::lock_guard lock{mutex};
+    ++created;
+    construction_time +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(dur);
+    return state;
+  }
+
+  void StatePool::Prewarm(std::size_t n)
+  {
+    std::vector<std::unique_ptr<State>> states;
+    states.reserve(n);
+    for (std::size_t i = 0; i < n; ++i) states.push_back(Create());
+
+    std::lock_guard lock{mutex};
+    free_states.reserve(free_states.size() + n);
+    for (auto& s : states) free_states.push_back(Libshit::Move(s));
+  }
+
+  StatePool::Handle StatePool::Acquire()
+  {
+    {
+      std::lock_guard lock{mutex};
+      if (!free_states.empty())
+      {
+        auto state = Libshit::Move(free_states.back());
+        free_states.pop_back();
+        return {*this, Libshit::Move(state)};
+      }
+    }
+    return {*this, Create()};
+  }
+
+  void StatePool::Release(std::unique_ptr<State> state) noexcept
+  {
+    if (!state) return;
+    // if the state can't be cleaned up, just throw it away
+    try { state->TranslateException(RestoreGlobals, *state); }
+    catch (const std::exception&) { return; }
+
+    try
+    {
+      std::lock_guard lock{mutex};
+      free_states.push_back(Libshit::Move(state));
+    }
+    catch (const std::exception&) {}
+  }
+
+  std::size_t StatePool::GetFreeCount() const
+  {
+    std::lock_guard lock{mutex};
+    return free_states.size();
+  }
+
+  std::size_t StatePool::GetCreatedCount() const
+  {
+    std::lock_guard lock{mutex};
+    return created;
+  }
+
+  std::chrono::nanoseconds StatePool::GetConstructionTime() const
+  {
+    std::lock_guard lock{mutex};
+    return construction_time;
+  }
+
+  TEST_CASE("prewarm and reuse")
+  {
+    StatePool pool{2};
+    CHECK(pool.GetCreatedCount() == 2);
+    CHECK(pool.GetFreeCount() == 2);
+
+    lua_State* vm;
+    {
+      auto h = pool.Acquire();
+      REQUIRE(h);
+      vm = *h;
+      CHECK(pool.GetFreeCount() == 1);
+
+      auto h2 = pool.Acquire();
+      auto h3 = pool.Acquire();
+      CHECK(pool.GetFreeCount() == 0);
+      CHECK(pool.GetCreatedCount() == 3);
+    }
+    CHECK(pool.GetFreeCount() == 3);
+    CHECK(pool.GetCreatedCount() == 3);
+
+    auto h = pool.Acquire();
+    CHECK(static_cast<lua_State*>(*h) == vm);
+  }
+
+  TEST_CASE("globals are restored")
+  {
+    StatePool pool{1};
+    {
+      auto h = pool.Acquire();
+      h->DoString("foo = 42 print = nil string = 3 lua_pushnil = 1");
+      lua_pushinteger(*h, 1);
+    }
+
+    auto h = pool.Acquire();
+    CHECK(pool.GetCreatedCount() == 1);
+    CHECK(lua_gettop(*h) == 0);
+    h->DoString(R"(
+assert(foo == nil)
+assert(type(print) == "function")
+assert(string.format("%d", 3) == "3")
+assert(lua_pushnil == nil)
+)");
+  }
+
+  TEST_SUITE_END();
+}
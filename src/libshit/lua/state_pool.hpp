@@ -0,0 +1,103 @@
+#ifndef UUID_B6743065_8E12_4E1A_8B9D_DB0A572F766D
+#define UUID_B6743065_8E12_4E1A_8B9D_DB0A572F766D
+#pragma once
+
+#if LIBSHIT_WITH_LUA
+
+#include "libshit/lua/base.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Libshit::Lua
+{
+
+  /**
+   * A thread-safe pool of fully initialized Lua::States.
+   *
+   * Creating a State means running every State::Register callback (type
+   * registration, bytecode loading...), which is slow. The pool creates states
+   * in advance, hands them out one at a time (a lua_State can only be used by a
+   * single thread at once, so use one state per worker) and takes them back
+   * after use.
+   *
+   * Lua has no way to clone a lua_State, so instead of copying a prototype, the
+   * pool takes a snapshot of the global table right after construction and
+   * restores it when a state is returned: globals added by the user are
+   * removed, overwritten globals are put back, the stack is cleared and a full
+   * garbage collection is run. Modifications made inside tables (for example
+   * changing a field in a type table) are not undone.
+   */
+  class StatePool
+  {
+  public:
+    class Handle
+    {
+    public:
+      Handle() noexcept = default;
+      Handle(Handle&& o) noexcept
+        : pool{o.pool}, state{Libshit::Move(o.state)} { o.pool = nullptr; }
+      Handle& operator=(Handle&& o) noexcept
+      {
+        Reset();
+        pool = o.pool; state = Libshit::Move(o.state); o.pool = nullptr;
+        return *this;
+      }
+      ~Handle() noexcept { Reset(); }
+
+      /// Return the state to the pool early.
+      void Reset() noexcept;
+
+      explicit operator bool() const noexcept { return state != nullptr; }
+      State& operator*() const noexcept { return *state; }
+      State* operator->() const noexcept { return state.get(); }
+      State* Get() const noexcept { return state.get(); }
+
+    private:
+      friend class StatePool;
+      Handle(StatePool& pool, std::unique_ptr<State> state) noexcept
+        : pool{&pool}, state{Libshit::Move(state)} {}
+
+      StatePool* pool = nullptr;
+      std::unique_ptr<State> state;
+    };
+
+    /// Create a pool with `prewarm` states constructed in advance.
+    explicit StatePool(std::size_t prewarm = 0);
+    ~StatePool() noexcept;
+    StatePool(const StatePool&) = delete;
+    void operator=(const StatePool&) = delete;
+
+    /**
+     * Get a state from the pool. If there are no free states left, a new one
+     * is created (outside of the pool's lock). Can be called from any thread.
+     */
+    Handle Acquire();
+
+    /// Construct `n` additional states and put them into the pool.
+    void Prewarm(std::size_t n);
+
+    /// Number of states currently waiting in the pool.
+    std::size_t GetFreeCount() const;
+    /// Number of states created by this pool so far.
+    std::size_t GetCreatedCount() const;
+    /// Total time spent constructing states.
+    std::chrono::nanoseconds GetConstructionTime() const;
+
+  private:
+    std::unique_ptr<State> Create();
+    void Release(std::unique_ptr<State> state) noexcept;
+
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<State>> free_states;
+    std::size_t created = 0;
+    std::chrono::nanoseconds construction_time{};
+  };
+
+}
+
+#endif
+#endif
@@ -7,13 +7,48 @@
 namespace Libshit::Lua
 {
 
+  // if name was registered lazily, push the stub table (turned into a normal
+  // table) and remove it from lazytbl
+  static bool PushLazyStub(StateRef vm, const char* name)
+  {
+    LIBSHIT_LUA_GETTOP(vm, top);
+    if (lua_rawgetp(vm, LUA_REGISTRYINDEX, &lazytbl) != LUA_TTABLE) // +1
+    {
+      lua_pop(vm, 1); // 0
+      return false;
+    }
+    if (lua_rawgetp(vm, -1, name+1) != LUA_TTABLE) // +2
+    {
+      lua_pop(vm, 2); // 0
+      return false;
+    }
+
+    lua_pushnil(vm); // +3
+    lua_rawsetp(vm, -3, name); // +2
+    lua_pushnil(vm); // +3
+    lua_rawsetp(vm, -3, name+1); // +2
+    lua_remove(vm, -2); // +1
+
+    lua_pushnil(vm); // +2
+    lua_rawsetp(vm, -2, &lazytbl); // +1
+    lua_pushnil(vm); // +2
+    lua_setmetatable(vm, -2); // +1
+
+    LIBSHIT_LUA_CHECKTOP(vm, top+1);
+    return true;
+  }
+
   TypeBuilder::TypeBuilder(StateRef vm, const char* name, bool instantiable)
     : vm{vm}, instantiable{instantiable}
+#if LIBSHIT_LUA_PROFILE
+    , type_name{name}
+#endif
   {
     LIBSHIT_LUA_GETTOP(vm, top);
 
     // type table
-    lua_createtable(vm, 0, 0); // +1
+    if (!PushLazyStub(vm, name)) // +1
+      lua_createtable(vm, 0, 0); // +1
     lua_pushvalue(vm, -1); // +2
     lua_rawsetp(vm, LUA_REGISTRYINDEX, name+1); // +1
 
@@ -164,6 +199,129 @@ namespace Libshit::Lua
     LIBSHIT_LUA_CHECKTOP(vm, top-1);
   }
 
+#if LIBSHIT_LUA_HAS_FFI
+  bool TypeBuilder::PushFfiFunction(const std::string& ctype, void* fun)
+  {
+    LIBSHIT_LUA_GETTOP(vm, top);
+
+    if (lua_getfield(vm, LUA_REGISTRYINDEX, "libshit_ffi_cast") != // +1
+        LUA_TFUNCTION)
+    {
+      lua_pop(vm, 1); // 0
+      LIBSHIT_LUA_CHECKTOP(vm, top);
+      return false;
+    }
+    lua_pushlstring(vm, ctype.data(), ctype.size()); // +2
+    lua_pushlightuserdata(vm, fun); // +3
+    lua_call(vm, 2, 1); // +1
+
+    LIBSHIT_LUA_CHECKTOP(vm, top+1);
+    return true;
+  }
+#endif
+
+  // stub[&lazytbl] is the init function, it replaces the stub's metatable
+  static void LazyRealize(lua_State* vm)
+  {
+    if (lua_rawgetp(vm, 1, &lazytbl) == LUA_TFUNCTION) // +1
+      lua_call(vm, 0, 0); // 0
+    else
+      lua_pop(vm, 1); // 0
+  }
+
+  static int LazyIndex(lua_State* vm)
+  {
+    LazyRealize(vm);
+    lua_settop(vm, 2);
+    lua_gettable(vm, 1);
+    return 1;
+  }
+
+  static int LazyNewIndex(lua_State* vm)
+  {
+    LazyRealize(vm);
+    lua_settop(vm, 3);
+    lua_settable(vm, 1);
+    return 0;
+  }
+
+  static int LazyCall(lua_State* vm)
+  {
+    LazyRealize(vm);
+    lua_call(vm, lua_gettop(vm)-1, LUA_MULTRET);
+    return lua_gettop(vm);
+  }
+
+  static int LazyPairs(lua_State* vm)
+  {
+    LazyRealize(vm);
+    lua_getglobal(vm, "pairs");
+    lua_pushvalue(vm, 1);
+    lua_call(vm, 1, 3);
+    return 3;
+  }
+
+  void TypeRegister::LazyRegister(StateRef vm, const char* name)
+  {
+    LIBSHIT_LUA_GETTOP(vm, top);
+    // -1: init function
+
+    // already registered (or pending)
+    if (!IsNoneOrNil(lua_rawgetp(vm, LUA_REGISTRYINDEX, name+1))) // +1
+    {
+      lua_pop(vm, 2); // -1
+      LIBSHIT_LUA_CHECKTOP(vm, top-1);
+      return;
+    }
+    lua_pop(vm, 1); // 0
+    auto t = lua_rawgetp(vm, LUA_REGISTRYINDEX, &lazytbl); // +1
+    LIBSHIT_ASSERT(t == LUA_TTABLE); (void) t;
+    if (!IsNoneOrNil(lua_rawgetp(vm, -1, name+1))) // +2
+    {
+      lua_pop(vm, 3); // -1
+      LIBSHIT_LUA_CHECKTOP(vm, top-1);
+      return;
+    }
+    lua_pop(vm, 1); // +1
+
+    // stub = setmetatable({[&lazytbl] = fun}, lazy_mt)
+    lua_createtable(vm, 0, 1); // +2
+    lua_pushvalue(vm, -3); // +3
+    lua_rawsetp(vm, -2, &lazytbl); // +2
+    if (lua_getfield(vm, LUA_REGISTRYINDEX, "libshit_lazy_mt") != // +3
+        LUA_TTABLE)
+    {
+      lua_pop(vm, 1); // +2
+      lua_createtable(vm, 0, 5); // +3
+      lua_pushcfunction(vm, LazyIndex); // +4
+      lua_setfield(vm, -2, "__index"); // +3
+      lua_pushcfunction(vm, LazyNewIndex); // +4
+      lua_setfield(vm, -2, "__newindex"); // +3
+      lua_pushcfunction(vm, LazyCall); // +4
+      lua_setfield(vm, -2, "__call"); // +3
+      lua_pushcfunction(vm, LazyPairs); // +4
+      lua_setfield(vm, -2, "__pairs"); // +3
+      lua_pushliteral(vm, "lazy type"); // +4
+      lua_setfield(vm, -2, "__name"); // +3
+      lua_pushvalue(vm, -1); // +4
+      lua_setfield(vm, LUA_REGISTRYINDEX, "libshit_lazy_mt"); // +3
+    }
+    lua_setmetatable(vm, -2); // +2
+
+    // lazytbl[name] = lazytbl[name+1] = stub
+    lua_pushvalue(vm, -1); // +3
+    lua_rawsetp(vm, -3, name); // +2
+    lua_pushvalue(vm, -1); // +3
+    lua_rawsetp(vm, -3, name+1); // +2
+
+    // set global name
+    lua_pushglobaltable(vm); // +3
+    vm.SetRecTable(name, -2); // +2
+    lua_pop(vm, 3); // -1
+
+    LIBSHIT_LUA_CHECKTOP(vm, top-1);
+  }
+
   int TypeBuilder::IsFunc(lua_State* vm) noexcept
   {
     if (!lua_getmetatable(vm, 1))
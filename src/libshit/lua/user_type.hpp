@@ -8,9 +8,11 @@
 
 #include "libshit/lua/function_call.hpp"
 #include "libshit/lua/type_traits.hpp"
+#include "libshit/startup_trace.hpp"
 
 #include <boost/config.hpp>
 #include <cstddef>
+#include <string>
 #include <type_traits>
 #include <utility>
 
@@ -50,6 +52,78 @@ namespace Libshit::Lua
   template <typename T>
   using LuaGetRef = typename Detail::LuaGetRefHlp<T>::Type;
 
+#if LIBSHIT_LUA_HAS_FFI
+  namespace Detail
+  {
+    constexpr const char* FfiIntName(std::size_t size, bool sign) noexcept
+    {
+      switch (size)
+      {
+      case 1: return sign ? "int8_t"  : "uint8_t";
+      case 2: return sign ? "int16_t" : "uint16_t";
+      case 4: return sign ? "int32_t" : "uint32_t";
+      case 8: return sign ? "int64_t" : "uint64_t";
+      default: return nullptr;
+      }
+    }
+
+    // ffi C type name of T, nullptr if T can't be passed through the ffi
+    template <typename T, typename Enable = void> struct FfiType
+    { static constexpr const char* NAME = nullptr; };
+
+    template <> struct FfiType<void>
+    { static constexpr const char* NAME = "void"; };
+    template <> struct FfiType<bool>
+    { static constexpr const char* NAME = "bool"; };
+    template <> struct FfiType<float>
+    { static constexpr const char* NAME = "float"; };
+    template <> struct FfiType<double>
+    { static constexpr const char* NAME = "double"; };
+
+    template <typename T>
+    struct FfiType<T, std::enable_if_t<
+      std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+    {
+      static constexpr const char* NAME =
+        FfiIntName(sizeof(T), std::is_signed_v<T>);
+    };
+
+    template <typename T>
+    struct FfiType<T, std::enable_if_t<std::is_enum_v<T>>>
+      : FfiType<std::underlying_type_t<T>> {};
+
+    // the ffi returns 64-bit integers as cdata, not lua numbers
+    template <typename T, typename Enable = void>
+    inline constexpr bool FFI_RETURNS_CDATA = false;
+    template <typename T>
+    inline constexpr bool FFI_RETURNS_CDATA<T, std::enable_if_t<
+      std::is_integral_v<T> || std::is_enum_v<T>>> = sizeof(T) == 8;
+
+    // only noexcept functions: unwinding through ffi frames is not supported
+    template <typename Fun> struct FfiSignature
+    { static constexpr bool VALID = false; };
+
+    template <typename Ret, typename... Args>
+    struct FfiSignature<Ret (*)(Args...) noexcept>
+    {
+      static constexpr bool VALID = FfiType<Ret>::NAME != nullptr &&
+        !FFI_RETURNS_CDATA<Ret> && ((FfiType<Args>::NAME != nullptr) && ...);
+
+      // ctype of a function pointer, like "double (*)(int32_t, double)"
+      static std::string Get()
+      {
+        std::string ret = FfiType<Ret>::NAME;
+        ret += " (*)(";
+        bool comma = false;
+        ((ret += comma ? ", " : "", ret += FfiType<Args>::NAME, comma = true),
+         ...);
+        ret += ')';
+        return ret;
+      }
+    };
+  }
+#endif
+
   template <typename Class, typename T, T Class::* Member>
   BOOST_FORCEINLINE
   T& GetMember(Class& cls) { return cls.*Member; }
@@ -86,6 +160,39 @@ namespace Libshit::Lua
     {
       vm.PushFunction<Funs...>();
       SetField(name);
+#if LIBSHIT_LUA_PROFILE
+      Detail::SetProfileName<Funs...>(type_name, name);
+#endif
+    }
+
+    /**
+     * Like AddFunction with a single function, but when running under LuaJIT
+     * and Fun is a noexcept free (or static member) function that only takes
+     * and returns numbers, it's registered as an ffi function pointer instead
+     * of a lua_CFunction wrapper, so calls to it can be compiled into traces.
+     * Functions returning 64-bit integers are not registered through the ffi,
+     * as they would return cdata instead of numbers. Falls back to
+     * AddFunction otherwise.
+     *
+     * @warning ffi functions don't behave exactly like AddFunction ones:
+     *   arguments are converted by the ffi, so there's no range or integer
+     *   check (fractional numbers are truncated, out of range values wrap
+     *   around), 64-bit integer arguments also accept cdata, and calls are
+     *   not visible to the lua profiler (LIBSHIT_LUA_PROFILE).
+     */
+    template <auto Fun>
+    void AddFfiFunction(const char* name)
+    {
+#if LIBSHIT_LUA_HAS_FFI
+      using Sig = Detail::FfiSignature<decltype(Fun)>;
+      if constexpr (Sig::VALID)
+        if (PushFfiFunction(Sig::Get(), reinterpret_cast<void*>(Fun)))
+        {
+          SetField(name);
+          return;
+        }
+#endif
+      AddFunction<Fun>(name);
     }
 
     template <typename T>
@@ -114,11 +221,19 @@ namespace Libshit::Lua
     struct InheritHelp;
 
     static int IsFunc(lua_State* vm) noexcept;
+#if LIBSHIT_LUA_HAS_FFI
+    // pushes fun casted to ctype, returns false (and pushes nothing) when the
+    // ffi library is not available
+    bool PushFfiFunction(const std::string& ctype, void* fun);
+#endif
 
     void DoInherit(ptrdiff_t offs);
 
     StateRef vm;
     bool instantiable;
+#if LIBSHIT_LUA_PROFILE
+    const char* type_name;
+#endif
   };
 
   class TypeRegister
@@ -138,6 +253,7 @@ namespace Libshit::Lua
       }
       if (doit)
       {
+        StartupTrace::Scope trace{"lua type", TYPE_NAME<Class>};
         TypeBuilder bld{
           vm, TYPE_NAME<Class>, UserTypeTraits<Class>::INSTANTIABLE};
         bld.Init<Class>();
@@ -152,11 +268,31 @@ namespace Libshit::Lua
     static void MultiRegister(StateRef vm)
     { ((Register<Args>(vm), lua_pop(vm, 1)), ...); }
 
+    /**
+     * Only put a stub table into the global namespace, the type is registered
+     * when the stub is first used from lua (indexed, called, etc.), or when
+     * it's needed by C++ (pushing an object of the type, AutoTable...). The
+     * stub table becomes the type table, so references to it remain valid.
+     */
+    template <typename... Args>
+    static void MultiLazyRegister(StateRef vm)
+    {
+      ((vm.PushFunction<&LazyInit<Args>>(),
+        LazyRegister(vm, TYPE_NAME<Args>)), ...);
+    }
+
     template <typename... Classes>
     struct StateRegister : State::Register
     {
-      StateRegister() : Register{&TypeRegister::MultiRegister<Classes...>} {}
+      StateRegister()
+        : Register{&TypeRegister::MultiLazyRegister<Classes...>} {}
     };
+
+  private:
+    template <typename Class>
+    static void LazyInit(StateRef vm) { MultiRegister<Class>(vm); }
+    // pops init function
+    static void LazyRegister(StateRef vm, const char* name);
   };
 
   template <typename Deriv>
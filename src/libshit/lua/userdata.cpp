@@ -18,8 +18,9 @@ namespace Libshit::Lua::Userdata
       LIBSHIT_LUA_CHECKTOP(vm, top);
       return false;
     }
-    auto type = lua_rawgetp(vm, LUA_REGISTRYINDEX, name); // +2
-    LIBSHIT_ASSERT(!IsNoneOrNil(type)); (void) type;
+    // can be nil if the type is registered lazily and not initialized yet,
+    // but then there can't be any object with that metatable either
+    lua_rawgetp(vm, LUA_REGISTRYINDEX, name); // +2
     auto ret = lua_rawequal(vm, -1, -2);
     lua_pop(vm, 2); // 0
 
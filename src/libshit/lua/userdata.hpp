@@ -53,7 +53,7 @@ namespace Libshit::Lua::Userdata
     LIBSHIT_LUA_GETTOP(vm, top);
     auto ptr = lua_newuserdata(vm, sizeof(T)); // +1
     LIBSHIT_ASSERT(ptr);
-    auto type = lua_rawgetp(vm, LUA_REGISTRYINDEX, TYPE_NAME<T>); // +2
+    auto type = GetRegisteredType(vm, TYPE_NAME<T>); // +2
     LIBSHIT_ASSERT(!IsNoneOrNil(type)); (void) type;
 
     new (ptr) T{std::forward<Args>(args)...};
@@ -80,7 +80,7 @@ namespace Libshit::Lua::Userdata
 
         // create object
         auto ud = lua_newuserdata(vm, sizeof(T)); // +1
-        auto type = lua_rawgetp(vm, LUA_REGISTRYINDEX, name); // +2
+        auto type = GetRegisteredType(vm, name); // +2
         LIBSHIT_ASSERT(type == LUA_TTABLE); (void) type;
 
         new (ud) T{std::forward<Args>(args)...};
@@ -1,13 +1,21 @@
 #include "libshit/options.hpp"
 
+#include "libshit/abomination.hpp"
+#include "libshit/char_utils.hpp"
+#include "libshit/low_io.hpp"
+#include "libshit/random.hpp"
+#include "libshit/string_utils.hpp"
+
 #include <algorithm>
 #include <array>
 #include <climits>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <iterator>
-#include <map>
 #include <string>
+#include <string_view>
 #include <type_traits>
 
 #include "libshit/doctest.hpp"
@@ -57,7 +65,10 @@ namespace Libshit
   OptionGroup::OptionGroup(
     OptionParser& parser, const char* name, const char* help)
     : name{name}, help{help}
-  { parser.AddOptionGroup(*this); }
+  {
+    parser.AddOptionGroup(*this);
+    StartupTrace::Mark("option group", name);
+  }
 
   OptionGroup& OptionGroup::GetCommands()
   {
@@ -161,21 +172,6 @@ namespace Libshit
     non_arg_fun = [](auto) { throw InvalidParam{"Invalid option"}; };
   }
 
-  namespace
-  {
-    struct OptCmp
-    {
-      bool operator()(const char* a, const char* b) const
-      {
-        while (*a && *a == *b) ++a, ++b;
-
-        if (*a == '=' || *b == '=') return false;
-        return *reinterpret_cast<const unsigned char*>(a) <
-          *reinterpret_cast<const unsigned char*>(b);
-      }
-    };
-  }
-
   static size_t ParseShort(
     OptionParser& parser, const std::array<Option*, 256>& short_opts,
     size_t argc, size_t i, const char** argv)
@@ -227,15 +223,19 @@ namespace Libshit
     }, [&](auto& e) { AddInfos(e, "Processed option", std::string{'-', *ptr}); });
   }
 
+  using LongOpts = std::vector<std::pair<const char*, Option*>>;
   static size_t ParseLong(
-    OptionParser& parser,
-    const std::map<const char*, Option*, OptCmp>& long_opts,
+    OptionParser& parser, const LongOpts& long_opts,
     size_t argc, size_t i, const char** argv)
   {
     auto arg = strchr(argv[i]+2, '=');
     auto len = arg ? arg - argv[i] - 2 : strlen(argv[i]+2);
 
-    auto it = long_opts.lower_bound(argv[i]+2);
+    // first option with this prefix, an exact match is always the first
+    auto it = std::lower_bound(
+      long_opts.begin(), long_opts.end(), argv[i]+2,
+      [len](const auto& o, const char* key)
+      { return strncmp(o.first, key, len) < 0; });
     if (it == long_opts.end() || strncmp(argv[i]+2, it->first, len))
       throw InvalidParam{"Unknown option"};
 
@@ -286,9 +286,66 @@ namespace Libshit
     return count;
   }
 
+  void OptionParser::UpdateIndex()
+  {
+    auto up_to_date = [&]()
+    {
+      auto it = indexed_opts.begin();
+      for (auto g : groups)
+        for (auto o : g->GetOptions())
+          if (o->enabled && (it == indexed_opts.end() || *it++ != o))
+            return false;
+      return it == indexed_opts.end();
+    };
+    if (up_to_date()) return;
+
+    indexed_opts.clear();
+    long_opts.clear();
+    short_opts = {};
+    static_assert(CHAR_BIT == 8);
+    try
+    {
+      for (auto g : groups)
+        for (auto o : g->GetOptions())
+        {
+          if (!o->enabled) continue;
+          indexed_opts.push_back(o);
+          long_opts.emplace_back(o->name, o);
+          if (o->short_name)
+          {
+            if (short_opts[static_cast<unsigned char>(o->short_name)])
+              LIBSHIT_THROW(std::logic_error, "Duplicate short option");
+            short_opts[static_cast<unsigned char>(o->short_name)] = o;
+          }
+        }
+
+      std::sort(long_opts.begin(), long_opts.end(),
+                [](const auto& a, const auto& b)
+                { return strcmp(a.first, b.first) < 0; });
+      auto dup = std::adjacent_find(
+        long_opts.begin(), long_opts.end(), [](const auto& a, const auto& b)
+        { return strcmp(a.first, b.first) == 0; });
+      if (dup != long_opts.end())
+        LIBSHIT_THROW(std::logic_error, "Duplicate long option");
+    }
+    catch (...)
+    {
+      indexed_opts.clear();
+      throw;
+    }
+  }
+
   void OptionParser::Run_(int& argc, const char** argv, bool has_argv0)
   {
+    AtScopeExit stop_trace{[]() { StartupTrace::Stop(); }};
     if (has_argv0) argv0 = argv[0];
+    if (config_file || env_prefix)
+    {
+      UpdateIndex();
+      if (config_file) RunConfigFile();
+      if (env_prefix) RunEnv();
+    }
+
     int endp = has_argv0;
     if (argc == has_argv0)
     {
@@ -300,33 +357,13 @@ namespace Libshit
       else return;
     }
 
-    std::array<Option*, 256> short_opts;
-    static_assert(CHAR_BIT == 8);
-    std::map<const char*, Option*, OptCmp> long_opts;
-
-    std::size_t old_len = 0;
+    // commands can add new groups while parsing
+    std::size_t old_len = std::size_t(-1);
     auto gen_opts = [&]()
     {
       if (old_len == groups.size()) return;
       old_len = groups.size();
-
-      short_opts = {};
-      long_opts.clear();
-      for (auto g : groups)
-        for (auto o : g->GetOptions())
-        {
-          if (!o->enabled) continue;
-          if (o->short_name)
-          {
-            if (short_opts[static_cast<unsigned char>(o->short_name)])
-              LIBSHIT_THROW(std::logic_error, "Duplicate short option");
-            short_opts[static_cast<unsigned char>(o->short_name)] = o;
-          }
-
-          auto x = long_opts.emplace(o->name, o);
-          if (!x.second)
-            LIBSHIT_THROW(std::logic_error, "Duplicate long option");
-        }
+      UpdateIndex();
     };
 
     for (int i = has_argv0; i < argc; ++i)
@@ -365,6 +402,12 @@ namespace Libshit
 
     argc = endp;
     argv[argc] = nullptr;
+    if (!non_arg_fun && non_args_fun)
+    {
+      non_args_fun({argv + has_argv0, std::size_t(argc - has_argv0)});
+      argc = has_argv0;
+      argv[argc] = nullptr;
+    }
 
     if (validate_fun && !validate_fun(argc, argv))
     {
@@ -373,9 +416,393 @@ namespace Libshit
     }
   }
 
+  static constexpr const int MAX_RESPONSE_FILE_DEPTH = 16;
+
+  // Split the file into shell-like words. If line_lens is not nullptr,
+  // newlines also end options, lines starting with `#` are skipped and the
+  // number of words in every non-empty line is pushed to line_lens. Returns
+  // the buffer holding the NUL-terminated words back to back, `used` is set
+  // to the number of used bytes in it.
+  static std::unique_ptr<char[]> ReadArgFile(
+    LowIo& io, std::vector<const char*>& tokens,
+    std::vector<std::uint32_t>* line_lens, std::size_t& used,
+    bool use_mmap = LowIo::MMAP_SUPPORTED)
+  {
+    auto size = io.GetSize();
+
+    // tokenize into a single buffer: every token is at most as long as its
+    // source and needs one extra NUL, and tokens are separated by at least one
+    // byte in the source except the last one, so `size+1` bytes are enough.
+    // Tokenizing in place is not possible, a NUL would overwrite the separator
+    // after the token, so read into a separate buffer if we can't mmap.
+    std::unique_ptr<char[]> buf{new char[size + 1]};
+    const char* src;
+    LowIo::MmapPtr map;
+    std::unique_ptr<char[]> read_buf;
+    if (use_mmap && size)
+    {
+      io.PrepareMmap(false);
+      map = io.Mmap(0, size, false);
+      src = static_cast<const char*>(map.Get());
+    }
+    else
+    {
+      read_buf.reset(new char[size]);
+      io.Read(read_buf.get(), size);
+      src = read_buf.get();
+    }
+
+    auto dst = buf.get();
+    auto line_start = tokens.size();
+    auto end_line = [&]()
+    {
+      if (line_lens && tokens.size() != line_start)
+        line_lens->push_back(tokens.size() - line_start);
+      line_start = tokens.size();
+    };
+    for (std::size_t i = 0; i < size; )
+    {
+      if (line_lens && src[i] == '\n') end_line();
+      if (Ascii::IsSpace(src[i])) { ++i; continue; }
+      if (line_lens && src[i] == '#' && tokens.size() == line_start)
+      {
+        while (i < size && src[i] != '\n') ++i;
+        continue;
+      }
+
+      tokens.push_back(dst);
+      char quote = 0;
+      for (; i < size; ++i)
+      {
+        auto c = src[i];
+        if (c == '\\' && quote != '\'' && i+1 < size) *dst++ = src[++i];
+        else if (quote)
+          if (c == quote) quote = 0;
+          else *dst++ = c;
+        else if (c == '\'' || c == '"') quote = c;
+        else if (Ascii::IsSpace(c)) break;
+        else *dst++ = c;
+      }
+      if (quote) throw InvalidParam{"Unterminated quote"};
+      *dst++ = '\0';
+    }
+    end_line();
+
+    used = dst - buf.get();
+    return buf;
+  }
+
+  static void ReadResponseFile(
+    const char* fname, std::vector<const char*>& tokens,
+    std::vector<std::unique_ptr<char[]>>& buffers)
+  {
+    LowIo io;
+    if (io.TryOpen(fname, LowIo::Permission::READ_ONLY,
+                   LowIo::Mode::OPEN_ONLY).first != LowIo::OpenError::OK)
+      throw InvalidParam{"Can't open response file"};
+    std::size_t used;
+    buffers.push_back(ReadArgFile(io, tokens, nullptr, used));
+  }
+
+  TEST_CASE("ReadArgFile")
+  {
+    {
+      LowIo io{"libshit_test_argfile", LowIo::Permission::WRITE_ONLY,
+               LowIo::Mode::TRUNC_OR_CREATE};
+      io.Write("foo bar\nbaz", 11);
+    }
+    AtScopeExit x{[]() { std::remove("libshit_test_argfile"); }};
+
+    auto test = [](bool use_mmap)
+    {
+      LowIo io{"libshit_test_argfile", LowIo::Permission::READ_ONLY,
+               LowIo::Mode::OPEN_ONLY};
+      std::vector<const char*> tokens;
+      std::vector<std::uint32_t> line_lens;
+      std::size_t used;
+      auto buf = ReadArgFile(io, tokens, &line_lens, used, use_mmap);
+      REQUIRE(tokens.size() == 3);
+      CHECK_STREQ(tokens[0], "foo");
+      CHECK_STREQ(tokens[1], "bar");
+      CHECK_STREQ(tokens[2], "baz");
+      CHECK(line_lens == std::vector<std::uint32_t>{2, 1});
+      CHECK(used == 12);
+    };
+    SUBCASE("read") { test(false); }
+    if (LowIo::MMAP_SUPPORTED) SUBCASE("mmap") { test(true); }
+  }
+
+  static void ExpandArg(
+    const char* arg, std::vector<const char*>& out, bool& dashdash,
+    std::vector<std::unique_ptr<char[]>>& buffers, int depth)
+  {
+    if (dashdash || arg[0] != '@' || arg[1] == '\0')
+    {
+      if (strcmp(arg, "--") == 0) dashdash = true;
+      out.push_back(arg);
+      return;
+    }
+
+    AddInfo([&]()
+    {
+      if (depth >= MAX_RESPONSE_FILE_DEPTH)
+        throw InvalidParam{"Response files nested too deep"};
+      std::vector<const char*> tokens;
+      ReadResponseFile(arg+1, tokens, buffers);
+      for (auto t : tokens) ExpandArg(t, out, dashdash, buffers, depth+1);
+    }, [&](auto& e)
+    {
+      if (depth == 0) AddInfos(e, "Processed option", arg);
+    });
+  }
+
+  bool OptionParser::ExpandResponseFiles(
+    int argc, const char** argv, bool has_argv0, Option::ArgVector& out)
+  {
+    if (!response_files) return false;
+    int i = has_argv0;
+    while (i < argc && argv[i][0] != '@' && strcmp(argv[i], "--")) ++i;
+    if (i == argc || argv[i][0] != '@') return false;
+
+    out.assign(argv, argv + i);
+    bool dashdash = false;
+    for (; i < argc; ++i)
+      ExpandArg(argv[i], out, dashdash, arg_buffers, 0);
+    return true;
+  }
+
+  namespace
+  {
+    struct ConfigCacheHeader
+    {
+      char magic[8];
+      // identify the config file: the same cache can be used with different
+      // config files
+      std::uint64_t mtime, size, file_id;
+      std::uint32_t path_size, line_count, blob_size, reserved;
+    };
+    constexpr const char CONFIG_CACHE_MAGIC[8] = "lsopt02";
+  }
+
+  // the cache stores the output of ReadArgFile: header, config file path, line
+  // lengths and the NUL-terminated words, native endian. `want` has the config
+  // file's identity. Returns nullptr if it's not valid.
+  static std::unique_ptr<char[]> ReadConfigCache(
+    const char* fname, const ConfigCacheHeader& want, std::string_view path,
+    std::vector<const char*>& tokens, std::vector<std::uint32_t>& line_lens)
+  {
+    LowIo io;
+    if (io.TryOpen(fname, LowIo::Permission::READ_ONLY,
+                   LowIo::Mode::OPEN_ONLY).first != LowIo::OpenError::OK)
+      return {};
+
+    auto cache_size = io.GetSize();
+    ConfigCacheHeader hdr;
+    if (cache_size < sizeof(hdr)) return {};
+    io.Read(&hdr, sizeof(hdr));
+    if (memcmp(hdr.magic, CONFIG_CACHE_MAGIC, sizeof(hdr.magic)) ||
+        hdr.mtime != want.mtime || hdr.size != want.size ||
+        hdr.file_id != want.file_id || hdr.path_size != path.size() ||
+        cache_size != sizeof(hdr) + hdr.path_size +
+        4 * std::uint64_t(hdr.line_count) + hdr.blob_size)
+      return {};
+
+    std::string cached_path(path.size(), '\0');
+    io.Read(cached_path.data(), cached_path.size());
+    if (cached_path != path) return {};
+
+    line_lens.resize(hdr.line_count);
+    io.Read(line_lens.data(), 4 * line_lens.size());
+    std::unique_ptr<char[]> buf{new char[hdr.blob_size]};
+    io.Read(buf.get(), hdr.blob_size);
+
+    std::uint64_t count = 0;
+    for (auto n : line_lens) count += n;
+    for (std::uint32_t i = 0; i < hdr.blob_size; )
+    {
+      tokens.push_back(buf.get() + i);
+      auto end = static_cast<const char*>(
+        memchr(buf.get() + i, 0, hdr.blob_size - i));
+      if (!end) break;
+      i = end - buf.get() + 1;
+    }
+    if (tokens.size() != count || (hdr.blob_size && buf[hdr.blob_size-1]) ||
+        std::count(line_lens.begin(), line_lens.end(), 0))
+    {
+      tokens.clear();
+      line_lens.clear();
+      return {};
+    }
+    return buf;
+  }
+
+  static void WriteConfigCache(
+    const char* fname, ConfigCacheHeader hdr, std::string_view path,
+    const std::vector<std::uint32_t>& line_lens, const char* blob,
+    std::uint32_t blob_size)
+  {
+    hdr.line_count = line_lens.size();
+    hdr.blob_size = blob_size;
+
+    // write a temporary file and rename it, so concurrent readers and writers
+    // never see a partial cache
+    auto tmp = Cat({fname, ".", std::to_string(
+          ThreadRandom().Gen<std::uint32_t>()), ".tmp"});
+    try
+    {
+      {
+        LowIo io{tmp.c_str(), LowIo::Permission::WRITE_ONLY,
+                 LowIo::Mode::CREATE_ONLY};
+        io.Write(&hdr, sizeof(hdr));
+        io.Write(path.data(), path.size());
+        io.Write(line_lens.data(), 4 * line_lens.size());
+        io.Write(blob, blob_size);
+      }
+      if (Abomination::rename(tmp.c_str(), fname))
+      {
+        // windows can't rename over an existing file
+        Abomination::unlink(fname);
+        if (Abomination::rename(tmp.c_str(), fname))
+          LIBSHIT_THROW_ERRNO("rename");
+      }
+    }
+    catch (...)
+    {
+      Abomination::unlink(tmp.c_str());
+      throw;
+    }
+  }
+
+  static Option* FindLongOption(
+    const LongOpts& long_opts, const char* name, std::size_t len)
+  {
+    auto it = std::lower_bound(
+      long_opts.begin(), long_opts.end(), name,
+      [len](const auto& o, const char* key)
+      { return strncmp(o.first, key, len) < 0; });
+    if (it == long_opts.end() || strncmp(it->first, name, len) ||
+        it->first[len] != '\0')
+      return nullptr;
+    return it->second;
+  }
+
+  void OptionParser::RunConfigFile()
+  {
+    LowIo io;
+    if (io.TryOpen(config_file, LowIo::Permission::READ_ONLY,
+                   LowIo::Mode::OPEN_ONLY).first != LowIo::OpenError::OK)
+      return;
+    ConfigCacheHeader id{};
+    std::string_view path = config_file;
+    if (config_cache)
+    {
+      memcpy(id.magic, CONFIG_CACHE_MAGIC, sizeof(id.magic));
+      id.mtime = io.GetModificationTime();
+      id.size = io.GetSize();
+      id.file_id = io.GetFileId();
+      id.path_size = path.size();
+    }
+
+    std::vector<const char*> tokens;
+    std::vector<std::uint32_t> line_lens;
+    std::unique_ptr<char[]> buf;
+    // the cache is only an optimization, ignore any problem with it
+    if (config_cache)
+      try
+      {
+        buf = ReadConfigCache(config_cache, id, path, tokens, line_lens);
+      }
+      catch (const std::exception&)
+      {
+        tokens.clear();
+        line_lens.clear();
+      }
+
+    if (!buf)
+    {
+      std::size_t used;
+      buf = AddInfo(
+        [&]() { return ReadArgFile(io, tokens, &line_lens, used); },
+        [&](auto& e) { AddInfos(e, "Processed option", config_file); });
+      if (config_cache && used <= std::numeric_limits<std::uint32_t>::max())
+        try
+        {
+          WriteConfigCache(config_cache, id, path, line_lens, buf.get(), used);
+        }
+        catch (const std::exception&) {}
+    }
+    arg_buffers.push_back(Move(buf));
+
+    auto tok = tokens.data();
+    for (auto n : line_lens)
+    {
+      auto name = tok[0];
+      auto eq = strchr(name, '=');
+      std::size_t len = eq ? eq - name : strlen(name);
+      Option::ArgVector args;
+      if (eq) args.push_back(eq+1);
+      args.insert(args.end(), tok+1, tok+n);
+      tok += n;
+
+      AddInfo([&]()
+      {
+        auto opt = FindLongOption(long_opts, name, len);
+        if (!opt) throw InvalidParam{"Unknown option"};
+        if (opt->args_count != Option::ALL_ARGS &&
+            args.size() != opt->args_count)
+          throw InvalidParam{"Invalid number of arguments"};
+        opt->func(*this, Move(args));
+      }, [&](auto& e)
+      {
+        AddInfos(e, "Processed option",
+                 Cat({config_file, ": --", {name, len}}));
+      });
+    }
+  }
+
+  void OptionParser::RunEnv()
+  {
+    std::string var = env_prefix;
+    auto prefix_len = var.size();
+    for (auto o : indexed_opts)
+    {
+      // LIBSHIT_HELP=1 in the environment shouldn't print help and exit
+      if (o->args_count > 1 || o == &help_option || o == &version_option)
+        continue;
+      var.resize(prefix_len);
+      for (auto p = o->name; *p; ++p)
+        var.push_back(Ascii::IsAlnum(*p) ? Ascii::ToUpper(*p) : '_');
+
+      auto val = Abomination::getenv(var.c_str());
+      if (!val) continue;
+      Option::ArgVector args;
+      if (o->args_count) args.push_back(val);
+      else if (!*val || strcmp(val, "0") == 0) continue;
+
+      AddInfo([&]() { o->func(*this, Move(args)); },
+              [&](auto& e) { AddInfos(e, "Processed option", var); });
+    }
+  }
+
   void OptionParser::Run(int& argc, const char** argv, bool has_argv0)
   {
-    try { Run_(argc, argv, has_argv0); }
+    try
+    {
+      Option::ArgVector expanded;
+      if (ExpandResponseFiles(argc, argv, has_argv0, expanded))
+      {
+        int size = expanded.size();
+        expanded.push_back(nullptr);
+        Run_(size, expanded.data(), has_argv0);
+        if (size > argc)
+          throw InvalidParam{
+            "Too many non-options from response files for argv"};
+        std::copy(expanded.begin(), expanded.begin() + size + 1, argv);
+        argc = size;
+      }
+      else
+        Run_(argc, argv, has_argv0);
+    }
     catch (const InvalidParam& p)
     {
       *os << p["Processed option"] << ": " << p.what() << std::endl;
@@ -385,11 +812,17 @@ namespace Libshit
 
   void OptionParser::Run(Option::ArgVector& args, bool has_argv0)
   {
-    int size = args.size();
-    AtScopeExit x{[&]() { args.resize(size); }};
-    args.push_back(nullptr);
-
-    try { Run_(size, args.data(), has_argv0); }
+    try
+    {
+      Option::ArgVector expanded;
+      if (ExpandResponseFiles(args.size(), args.data(), has_argv0, expanded))
+        args = Move(expanded);
+
+      int size = args.size();
+      AtScopeExit x{[&]() { args.resize(size); }};
+      args.push_back(nullptr);
+      Run_(size, args.data(), has_argv0);
+    }
     catch (const InvalidParam& p)
     {
       *os << p["Processed option"] << ": " << p.what() << std::endl;
@@ -700,6 +1133,246 @@ namespace Libshit
     CHECK_STREQ(b41, e41);
   }
 
+  TEST_CASE_FIXTURE(TestFixture, "option index update")
+  {
+    OptionGroup grp{parser, "Foo"};
+    int a = 0, b = 0;
+    Option opt_a{grp, "aaa", 'a', 0, nullptr, nullptr,
+      [&](auto&, auto&&) { ++a; }};
+    Option opt_b{grp, "aab", 0, nullptr, nullptr,
+      [&](auto&, auto&&) { ++b; }};
+
+    auto run = [&](const char* arg)
+    {
+      const char* argv[] = { "foo", arg, nullptr };
+      int argc = 2;
+      parser.Run(argc, argv);
+    };
+
+    run("--aab");
+    run("-a");
+    CHECK(a == 1); CHECK(b == 1);
+
+    // ambiguous until one of them is disabled
+    opt_a.enabled = false;
+    run("--aa");
+    CHECK(a == 1); CHECK(b == 2);
+    opt_a.enabled = true;
+    CHECK_THROWS_AS(run("--aa"), Exit);
+    CHECK(ss.str() == "--aa: Ambiguous option (candidates: --aaa --aab)\n");
+
+    OptionGroup grp2{parser, "Bar"};
+    Option opt_c{grp2, "aac", 'c', 0, nullptr, nullptr,
+      [&](auto&, auto&&) { ++b; }};
+    run("-c");
+    CHECK(b == 3);
+  }
+
+  TEST_CASE_FIXTURE(TestFixture, "response files")
+  {
+    OptionGroup grp{parser, "Foo"};
+    std::vector<std::string> vals;
+    Option opt{grp, "val", 'v', 1, "STRING", nullptr,
+      [&](auto&, auto&& args) { vals.push_back(args.front()); }};
+    parser.SetResponseFiles();
+
+    auto write = [](const char* fname, std::string_view content)
+    {
+      LowIo io{fname, LowIo::Permission::WRITE_ONLY,
+               LowIo::Mode::TRUNC_OR_CREATE};
+      io.Write(content.data(), content.size());
+    };
+    write("libshit_test_rsp1",
+          "-v a --val=\"b c\"\n'd\\e' f\\ g @libshit_test_rsp2");
+    write("libshit_test_rsp2", "-v\t\"\\\"x\\\\\"");
+    AtScopeExit x{[]()
+    {
+      std::remove("libshit_test_rsp1");
+      std::remove("libshit_test_rsp2");
+    }};
+
+    SUBCASE("argc/argv")
+    {
+      const char* argv[] = { "foo", "@libshit_test_rsp1", "--",
+                             "@libshit_test_rsp2", nullptr };
+      int argc = 4;
+      parser.Run(argc, argv);
+      CHECK(vals == std::vector<std::string>{"a", "b c", "\"x\\"});
+      REQUIRE(argc == 4);
+      CHECK_STREQ(argv[1], "d\\e");
+      CHECK_STREQ(argv[2], "f g");
+      CHECK_STREQ(argv[3], "@libshit_test_rsp2");
+      CHECK(argv[4] == nullptr);
+    }
+
+    SUBCASE("batched non-args")
+    {
+      std::vector<std::string> non_args;
+      parser.SetNonArgsHandler([&](Span<const char* const> args)
+      { non_args.assign(args.begin(), args.end()); });
+
+      Option::ArgVector args{"foo", "x", "@libshit_test_rsp2", "--", "@y"};
+      parser.Run(args, true);
+      CHECK(vals == std::vector<std::string>{"\"x\\"});
+      CHECK(non_args == std::vector<std::string>{"x", "@y"});
+      REQUIRE(args.size() == 1);
+      CHECK_STREQ(args[0], "foo");
+    }
+
+    SUBCASE("not enough space in argv")
+    {
+      const char* argv[] = { "foo", "@libshit_test_rsp1", nullptr };
+      int argc = 2;
+      CHECK_THROWS_AS(parser.Run(argc, argv), Exit);
+    }
+
+    SUBCASE("missing file")
+    {
+      const char* argv[] = { "foo", "@libshit_test_nonexistent", nullptr };
+      int argc = 2;
+      CHECK_THROWS_AS(parser.Run(argc, argv), Exit);
+      CHECK(ss.str() ==
+            "@libshit_test_nonexistent: Can't open response file\n");
+    }
+
+    SUBCASE("disabled")
+    {
+      parser.SetResponseFiles(false);
+      const char* argv[] = { "foo", "@libshit_test_rsp1", nullptr };
+      int argc = 2;
+      parser.Run(argc, argv);
+      CHECK(argc == 2);
+      CHECK(vals.empty());
+    }
+  }
+
+  TEST_CASE_FIXTURE(TestFixture, "config file and environment")
+  {
+    OptionGroup grp{parser, "Foo"};
+    std::vector<std::string> vals;
+    int flag = 0;
+    Option val_opt{grp, "val", 'v', 1, "STRING", nullptr,
+      [&](auto&, auto&& args) { vals.push_back(args.front()); }};
+    Option flag_opt{grp, "some-flag", 0, nullptr, nullptr,
+      [&](auto&, auto&&) { ++flag; }};
+    Option multi_opt{grp, "multi", 2, "A B", nullptr,
+      [&](auto&, auto&& args) { vals.push_back(Cat({args[0], args[1]})); }};
+
+    auto write = [](const char* fname, std::string_view content)
+    {
+      LowIo io{fname, LowIo::Permission::WRITE_ONLY,
+               LowIo::Mode::TRUNC_OR_CREATE};
+      io.Write(content.data(), content.size());
+    };
+    write("libshit_test_cfg",
+          "# comment\nval=cfg1\n\n  some-flag\nmulti \"a \" b\r\nval cfg2\n");
+    Abomination::setenv("LIBSHIT_TEST_VAL", "env", 1);
+    Abomination::setenv("LIBSHIT_TEST_SOME_FLAG", "0", 1);
+    AtScopeExit x{[]()
+    {
+      std::remove("libshit_test_cfg");
+      std::remove("libshit_test_cfg_cache");
+      Abomination::unsetenv("LIBSHIT_TEST_VAL");
+      Abomination::unsetenv("LIBSHIT_TEST_SOME_FLAG");
+    }};
+
+    auto run = [&]()
+    {
+      vals.clear();
+      const char* argv[] = { "foo", "-v", "arg", nullptr };
+      int argc = 3;
+      parser.Run(argc, argv);
+      CHECK(argc == 1);
+    };
+    parser.SetEnvPrefix("LIBSHIT_TEST_");
+
+    SUBCASE("no cache")
+    {
+      parser.SetConfigFile("libshit_test_cfg");
+      run();
+      CHECK(vals == std::vector<std::string>{
+          "cfg1", "a b", "cfg2", "env", "arg"});
+      CHECK(flag == 1);
+    }
+
+    SUBCASE("cache")
+    {
+      parser.SetConfigFile("libshit_test_cfg", "libshit_test_cfg_cache");
+      run();
+      CHECK(vals == std::vector<std::string>{
+          "cfg1", "a b", "cfg2", "env", "arg"});
+
+      // patch the cache to check that it's actually used
+      std::string cache;
+      {
+        LowIo io{"libshit_test_cfg_cache", LowIo::Permission::READ_ONLY,
+                 LowIo::Mode::OPEN_ONLY};
+        cache.resize(io.GetSize());
+        io.Read(cache.data(), cache.size());
+      }
+      auto pos = cache.find("cfg1");
+      REQUIRE(pos != std::string::npos);
+      cache[pos+3] = '9';
+      write("libshit_test_cfg_cache", cache);
+      run();
+      CHECK(vals == std::vector<std::string>{
+          "cfg9", "a b", "cfg2", "env", "arg"});
+
+      // different size invalidates the cache
+      write("libshit_test_cfg", "val=new\n");
+      run();
+      CHECK(vals == std::vector<std::string>{"new", "env", "arg"});
+      CHECK(flag == 2);
+
+      // so does a different config file
+      write("libshit_test_cfg2", "val=ne2\n");
+      AtScopeExit x2{[]() { std::remove("libshit_test_cfg2"); }};
+      parser.SetConfigFile("libshit_test_cfg2", "libshit_test_cfg_cache");
+      run();
+      CHECK(vals == std::vector<std::string>{"ne2", "env", "arg"});
+    }
+
+    SUBCASE("help and version ignored")
+    {
+      Abomination::setenv("LIBSHIT_TEST_HELP", "1", 1);
+      Abomination::setenv("LIBSHIT_TEST_VERSION", "1", 1);
+      AtScopeExit x2{[]()
+      {
+        Abomination::unsetenv("LIBSHIT_TEST_HELP");
+        Abomination::unsetenv("LIBSHIT_TEST_VERSION");
+      }};
+      run();
+      CHECK(vals == std::vector<std::string>{"env", "arg"});
+      CHECK(ss.str() == "");
+    }
+
+    SUBCASE("env flag")
+    {
+      Abomination::setenv("LIBSHIT_TEST_SOME_FLAG", "1", 1);
+      run();
+      CHECK(vals == std::vector<std::string>{"env", "arg"});
+      CHECK(flag == 1);
+    }
+
+    SUBCASE("invalid config")
+    {
+      write("libshit_test_cfg", "val 1 2\n");
+      parser.SetConfigFile("libshit_test_cfg");
+      const char* argv[] = { "foo", nullptr };
+      int argc = 1;
+      CHECK_THROWS_AS(parser.Run(argc, argv), Exit);
+      CHECK(ss.str() ==
+            "libshit_test_cfg: --val: Invalid number of arguments\n");
+    }
+
+    SUBCASE("missing config")
+    {
+      parser.SetConfigFile("libshit_test_nonexistent");
+      run();
+      CHECK(vals == std::vector<std::string>{"env", "arg"});
+    }
+  }
+
   TEST_CASE_FIXTURE(TestFixture, "non-unique prefix")
   {
     OptionGroup grp{parser, "Foo", "Description of foo"};
@@ -4,12 +4,17 @@
 
 #include "libshit/except.hpp"
 #include "libshit/function.hpp"
+#include "libshit/span.hpp"
+#include "libshit/startup_trace.hpp"
 #include "libshit/utils.hpp"
 
+#include <array>
 #include <cstddef>
 #include <iosfwd>
 #include <limits>
+#include <memory>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 namespace Libshit
@@ -52,7 +57,10 @@ namespace Libshit
            Func func)
       : name{name}, short_name{short_name}, args_count{args_count},
         args_help{args_help}, help{help}, func{Move(func)}
-    { group.options.push_back(this); }
+    {
+      group.options.push_back(this);
+      StartupTrace::Mark("option", name);
+    }
 
     Option(OptionGroup& group, const char* name, std::size_t args_count,
            const char* args_help, const char* help, Func func)
@@ -94,6 +102,53 @@ namespace Libshit
     void FailOnNonArg();
     const NonArgFun& GetNonArgHandler() const noexcept { return non_arg_fun; }
 
+    using NonArgsFun = Function<void (Span<const char* const>)>;
+    /**
+     * Called once with every non-argument after parsing all options. Only
+     * used when there's no NonArgHandler. Non-arguments are not left in argv.
+     */
+    void SetNonArgsHandler(NonArgsFun fun) { non_args_fun = Move(fun); }
+    const NonArgsFun& GetNonArgsHandler() const noexcept
+    { return non_args_fun; }
+
+    /**
+     * Replace `@file` arguments with the contents of `file`, split at
+     * whitespace (single and double quotes and backslash escapes work like in
+     * a shell, `@file`s can be nested). The strings live as long as the
+     * OptionParser.
+     */
+    void SetResponseFiles(bool enable = true) noexcept
+    { response_files = enable; }
+    bool GetResponseFiles() const noexcept { return response_files; }
+
+    /**
+     * Read options from `fname` before the command line. Every line is an
+     * option name without the leading `--`, followed by its arguments as
+     * `name=arg` or as separate words (quoting works like in response files),
+     * lines starting with `#` are comments. Only exact option names are
+     * accepted. A missing file is not an error.
+     *
+     * If `cache_fname` is not nullptr, the parsed file is stored there and
+     * reused while the size and modification time of the config file doesn't
+     * change. Outside of Linux and Windows the modification time only has a
+     * second resolution, so a same sized edit within a second of writing the
+     * cache goes unnoticed.
+     */
+    void SetConfigFile(
+      const char* fname, const char* cache_fname = nullptr) noexcept
+    { config_file = fname; config_cache = cache_fname; }
+    const char* GetConfigFile() const noexcept { return config_file; }
+
+    /**
+     * Read options from environment variables after the config file and
+     * before the command line. With `LIBSHIT_` prefix, `--foo-bar` is read
+     * from `LIBSHIT_FOO_BAR`. Options without arguments are enabled unless the
+     * variable is empty or `0`, options with more than one argument can't be
+     * set this way.
+     */
+    void SetEnvPrefix(const char* prefix) noexcept { env_prefix = prefix; }
+    const char* GetEnvPrefix() const noexcept { return env_prefix; }
+
     using ValidateFun = Function<bool (int, const char**)>;
     /**
      * Called after parsing all arguments and non-arguments, can be used for
@@ -110,10 +165,18 @@ namespace Libshit
     void SetOstream(std::ostream& os) { this->os = &os; }
     std::ostream& GetOstream() noexcept { return *os; }
 
+    /**
+     * Parse the options, and leave the non-options in argv (unless a
+     * non-argument handler consumes them). With response files, the expanded
+     * non-options might not fit into argv: this is only known after parsing,
+     * so it's an error after the option callbacks already ran. Use the
+     * ArgVector overload or a non-argument handler if this is a problem.
+     */
     void Run(int& argc, char** argv, bool has_argv0 = true)
     { Run(argc, const_cast<const char**>(argv), has_argv0); }
     void Run(int& argc, const char** argv, bool has_argv0 = true);
 
+    /// Same as above, but `args` is resized to hold the non-options.
     void Run(Option::ArgVector& args, bool has_argv0);
 
     void ShowHelp() const;
@@ -130,17 +193,33 @@ namespace Libshit
 
   private:
     void Run_(int& argc, const char** argv, bool has_argv0);
+    void UpdateIndex();
+    bool ExpandResponseFiles(
+      int argc, const char** argv, bool has_argv0, Option::ArgVector& out);
+    void RunConfigFile();
+    void RunEnv();
 
     std::vector<OptionGroup*> groups;
 
+    // lookup tables of the enabled options, only rebuilt when they change
+    std::vector<Option*> indexed_opts; // in groups order, to detect changes
+    std::vector<std::pair<const char*, Option*>> long_opts; // sorted by name
+    std::array<Option*, 256> short_opts{};
+
     const char* version = nullptr;
     const char* usage = nullptr;
     OptionGroup help_version;
     Option help_option, version_option;
     NonArgFun non_arg_fun;
+    NonArgsFun non_args_fun;
     ValidateFun validate_fun;
     bool no_opts_help = false;
     bool was_command = false;
+    bool response_files = false;
+    const char* config_file = nullptr;
+    const char* config_cache = nullptr;
+    const char* env_prefix = nullptr;
+    std::vector<std::unique_ptr<char[]>> arg_buffers;
 
     std::ostream* os;
     const char* argv0 = nullptr;
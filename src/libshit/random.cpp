@@ -3,6 +3,10 @@
 #include "libshit/except.hpp"
 #include "libshit/platform.hpp"
 
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
 #if LIBSHIT_OS_IS_WINDOWS
 #  define WIN32_LEAN_AND_MEAN
 #  define NOMINMAX
@@ -14,8 +18,12 @@ extern "C" BOOLEAN NTAPI SystemFunction036(PVOID, ULONG);
 #  include <unistd.h>
 #endif
 
+#include "libshit/doctest.hpp"
+
 namespace Libshit
 {
+  TEST_SUITE_BEGIN("Libshit::Random");
+
   void FillRandom(Span<std::byte> buf)
   {
 #if LIBSHIT_OS_IS_WINDOWS
@@ -31,4 +39,169 @@ namespace Libshit
       LIBSHIT_THROW_ERRNO("getentropy");
 #endif
   }
+
+  static Xoshiro256p SplitGlobal() noexcept
+  {
+    static std::mutex mutex;
+    static Xoshiro256p global;
+    std::lock_guard lock{mutex};
+    return global.Split();
+  }
+
+  Xoshiro256p& ThreadRandom() noexcept
+  {
+    thread_local Xoshiro256p rnd{SplitGlobal()};
+    return rnd;
+  }
+
+  TEST_CASE_TEMPLATE("Fill matches Gen", T, Xoshiro128p, Xoshiro256p)
+  {
+    T a{{1, 2, 3, 4}}, b{{1, 2, 3, 4}};
+    using N = typename T::NativeType;
+
+    std::vector<N> blocks(1000);
+    a.Fill(Span<N>{blocks});
+    for (auto x : blocks) CHECK(x == b.GenBlock());
+
+    std::vector<std::uint8_t> bytes(77);
+    a.Fill(Span<std::uint8_t>{bytes});
+    for (auto x : bytes) CHECK(x == b.template Gen<std::uint8_t>());
+
+    std::vector<float> floats(130);
+    a.Fill(Span<float>{floats}, 3.f);
+    for (auto x : floats)
+    {
+      CHECK(x == b.template Gen<float>(3.f));
+      CHECK(x >= 0); CHECK(x < 3);
+    }
+
+    std::vector<int> ints(100);
+    a.Fill(Span<int>{ints}, 7);
+    for (auto x : ints) CHECK(x == b.template Gen<int>(7));
+  }
+
+  TEST_CASE("XoshiropLanes")
+  {
+    Xoshiro128pX8::Seed seed;
+    for (std::uint32_t i = 0; i < 8; ++i) seed[i] = {i+1, 2, 3, 4};
+    Xoshiro128pX8 a{seed}, b{seed};
+    Xoshiro128p lane3{seed[3]};
+
+    // uneven chunks to test the buffering
+    std::vector<std::uint32_t> out(1000);
+    Span<std::uint32_t> s{out};
+    for (std::size_t off = 0, n = 1; off < out.size(); off += n, n = n*3 % 17 + 1)
+    {
+      n = std::min(n, out.size() - off);
+      a.FillBlocks(s.subspan(off, n));
+    }
+
+    for (std::size_t i = 0; i < out.size(); ++i)
+    {
+      CHECK(out[i] == b.GenBlock());
+      if (i % 8 == 3) CHECK(out[i] == lane3.GenBlock());
+    }
+  }
+
+  TEST_CASE("Jump")
+  {
+    // reference values computed by raising the transition matrix to 2^n
+    SUBCASE("xoshiro128+")
+    {
+      Xoshiro128p a{{1, 2, 3, 4}}, b{{1, 2, 3, 4}};
+      a.Jump();
+      CHECK(a.GetState() == std::array<std::uint32_t, 4>{
+          2843103750, 2038079848, 1533207345, 44816753});
+      b.LongJump();
+      CHECK(b.GetState() == std::array<std::uint32_t, 4>{
+          1611968294, 2125834322, 966769569, 3193880526});
+    }
+
+    SUBCASE("xoshiro256+")
+    {
+      Xoshiro256p a{{1, 2, 3, 4}}, b{{1, 2, 3, 4}};
+      a.Jump();
+      CHECK(a.GetState() == std::array<std::uint64_t, 4>{
+          10122426448480695249u, 8079205330032121950u,
+          7289065458748526725u, 9477464255293849680u});
+      b.LongJump();
+      CHECK(b.GetState() == std::array<std::uint64_t, 4>{
+          678511610814637056u, 15850499779492529430u,
+          6002989639035333134u, 3559352929785830385u});
+    }
+  }
+
+  TEST_CASE("Split")
+  {
+    Xoshiro256p a{{1, 2, 3, 4}}, b{{1, 2, 3, 4}};
+    auto c = a.Split();
+    CHECK(c.GetState() == std::array<std::uint64_t, 4>{1, 2, 3, 4});
+    b.Jump();
+    CHECK(a.GetState() == b.GetState());
+
+    Xoshiro256p lane1{b.GetState()};
+    lane1.Jump();
+    Xoshiro256pX4 lanes{b};
+    for (int i = 0; i < 40; ++i)
+    {
+      auto x = lanes.GenBlock();
+      if (i % 4 == 1) CHECK(x == lane1.GenBlock());
+    }
+  }
+
+  TEST_CASE("MulWide")
+  {
+    Xoshiro256p rnd{{1, 2, 3, 4}};
+    for (int i = 0; i < 1000; ++i)
+    {
+      auto a = rnd.GenBlock(), b = rnd.GenBlock();
+      std::uint64_t hi, lo;
+      Detail::MulWidePortable(a, b, hi, lo);
+      CHECK(lo == a * b);
+#ifdef __SIZEOF_INT128__
+      CHECK(hi == std::uint64_t((static_cast<unsigned __int128>(a) * b) >> 64));
+#endif
+    }
+  }
+
+  TEST_CASE_TEMPLATE("bounded generation", T, Xoshiro128p, Xoshiro256p)
+  {
+    T a{{1, 2, 3, 4}}, b{{1, 2, 3, 4}};
+
+    // compile-time and runtime bounds generate the same sequence
+    for (int i = 0; i < 100; ++i)
+    {
+      CHECK(a.template Gen<int, 7>() == b.template Gen<int>(7));
+      CHECK(a.template Gen<unsigned, 64>() == b.template Gen<unsigned>(64));
+      CHECK(a.template Gen<std::uint8_t, 255>() ==
+            b.template Gen<std::uint8_t>(255));
+    }
+
+    std::array<unsigned, 10> hist{};
+    std::vector<unsigned> vals(10000);
+    a.GenN(10, Span<unsigned>{vals});
+    for (auto v : vals)
+    {
+      REQUIRE(v < 10);
+      ++hist[v];
+    }
+    for (auto h : hist) { CHECK(h > 800); CHECK(h < 1200); }
+
+    std::vector<int> perm(100);
+    for (int i = 0; i < 100; ++i) perm[i] = i;
+    auto orig = perm;
+    a.Shuffle(Span<int>{perm});
+    CHECK(perm != orig);
+    std::sort(perm.begin(), perm.end());
+    for (int i = 0; i < 100; ++i) CHECK(perm[i] == i);
+  }
+
+  TEST_CASE("ThreadRandom")
+  {
+    auto& a = ThreadRandom();
+    CHECK(&a == &ThreadRandom());
+    a.GenBlock();
+  }
+
+  TEST_SUITE_END();
 }
@@ -12,6 +12,7 @@
 #include <cstdint>
 #include <limits>
 #include <type_traits>
+#include <utility>
 
 namespace Libshit
 {
@@ -37,6 +38,56 @@ namespace Libshit
     : std::integral_constant<std::size_t, CHAR_BIT * sizeof(T)> {};
   template<> struct Bits<bool> : std::integral_constant<std::size_t, 1> {};
 
+  namespace Detail
+  {
+    template <typename T>
+    constexpr inline T Rotl(T x, std::size_t k) noexcept
+    { return (x << k) | (x >> (Bits<T>::value - k)); }
+
+    constexpr inline void MulWidePortable(
+      std::uint64_t a, std::uint64_t b,
+      std::uint64_t& hi, std::uint64_t& lo) noexcept
+    {
+      std::uint64_t a_lo = std::uint32_t(a), a_hi = a >> 32;
+      std::uint64_t b_lo = std::uint32_t(b), b_hi = b >> 32;
+      auto p0 = a_lo * b_lo, p1 = a_lo * b_hi, p2 = a_hi * b_lo;
+      auto mid = (p0 >> 32) + std::uint32_t(p1) + std::uint32_t(p2);
+      hi = a_hi * b_hi + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+      lo = (mid << 32) | std::uint32_t(p0);
+    }
+
+    /// Full a*b, hi:lo
+    template <typename T>
+    constexpr inline void MulWide(T a, T b, T& hi, T& lo) noexcept
+    {
+      if constexpr (sizeof(T) <= sizeof(std::uint32_t))
+      {
+        auto m = std::uint64_t(a) * b;
+        hi = m >> Bits<T>::value;
+        lo = T(m);
+      }
+      else
+      {
+        static_assert(sizeof(T) == sizeof(std::uint64_t));
+#ifdef __SIZEOF_INT128__
+        auto m = static_cast<unsigned __int128>(a) * b;
+        hi = m >> 64;
+        lo = T(m);
+#else
+        MulWidePortable(a, b, hi, lo);
+#endif
+      }
+    }
+
+    template <typename T>
+    constexpr inline std::size_t Log2(T x) noexcept
+    {
+      std::size_t res = 0;
+      while (x >>= 1) ++res;
+      return res;
+    }
+  }
+
   template <typename T, typename Derived>
   struct RandomGeneratorBase
   {
@@ -47,11 +98,7 @@ namespace Libshit
     // Same as Gen<U, 1 << Bits<U>::value>, except handles overflow in <<.
     template <typename U>
     constexpr std::enable_if_t<std::is_integral_v<U>, U> Gen() noexcept
-    {
-      static_assert(Bits<U>::value <= Bits<T>::value);
-      T t = static_cast<Derived*>(this)->GenBlock();
-      return t >> (Bits<T>::value - Bits<U>::value);
-    }
+    { return FromBlock<U>(static_cast<Derived*>(this)->GenBlock()); }
 
     /**
      * Generate bool or integer in range [0, mod).
@@ -64,13 +111,19 @@ namespace Libshit
       static_assert(mod >= 2);
       static_assert(mod <= std::numeric_limits<T>::max());
 
-      constexpr T div = (std::numeric_limits<T>::max() - (mod-1)) / mod + 1;
-      T g;
-      do
-        g = static_cast<Derived*>(this)->GenBlock();
-      while (g > div * mod - 1);
-
-      return g / div;
+      if constexpr ((mod & (mod-1)) == 0)
+        return static_cast<Derived*>(this)->GenBlock() >>
+          (Bits<T>::value - Detail::Log2(mod));
+      else
+      {
+        constexpr T threshold = T(-T(mod)) % T(mod);
+        T hi, lo;
+        do
+          Detail::MulWide(
+            static_cast<Derived*>(this)->GenBlock(), T(mod), hi, lo);
+        while (lo < threshold);
+        return hi;
+      }
     }
 
     /**
@@ -84,14 +137,7 @@ namespace Libshit
     {
       if (mod < 2) return 0;
       LIBSHIT_ASSERT(mod <= std::numeric_limits<T>::max());
-
-      T div = (std::numeric_limits<T>::max() - (mod-1)) / mod + 1;
-      T g;
-      do
-        g = static_cast<Derived*>(this)->GenBlock();
-      while (g > div * mod - 1);
-
-      return g / div;
+      return Bounded(static_cast<Derived*>(this)->GenBlock(), mod);
     }
 
     /**
@@ -123,12 +169,132 @@ namespace Libshit
     template <typename U>
     constexpr std::enable_if_t<std::is_floating_point_v<U>, U>
       Gen(U mul = 1) noexcept
+    { return FromBlock<U>(static_cast<Derived*>(this)->GenBlock(), mul); }
+
+    /**
+     * Fill out with raw GenBlock() values. Generators can override it with a
+     * faster implementation, but it must produce the same sequence as calling
+     * GenBlock() repeatedly.
+     */
+    constexpr void FillBlocks(Span<T> out) noexcept
+    { for (auto& x : out) x = static_cast<Derived*>(this)->GenBlock(); }
+
+    /**
+     * Fill out with random numbers. Produces the same values as calling
+     * `Gen<U>()` (integral or bool) or `Gen<U>(mul)` (floating point) for every
+     * element, but generates the raw blocks in bulk.
+     */
+    template <typename U>
+    std::enable_if_t<std::is_integral_v<U>> Fill(Span<U> out) noexcept
+    {
+      if constexpr (std::is_same_v<U, T>)
+        static_cast<Derived*>(this)->FillBlocks(out);
+      else
+        FillConvert(out, [](T g) { return FromBlock<U>(g); });
+    }
+
+    template <typename U>
+    std::enable_if_t<std::is_floating_point_v<U>>
+    Fill(Span<U> out, U mul = 1) noexcept
+    { FillConvert(out, [mul](T g) { return FromBlock<U>(g, mul); }); }
+
+    /// Same as calling `Gen<U>(mod)` for every element of out.
+    template <typename U>
+    std::enable_if_t<std::is_integral_v<U>>
+    Fill(Span<U> out, MakeUnsignedBoolT<U> mod) noexcept
+    { for (auto& x : out) x = Gen<U>(mod); }
+
+    /**
+     * Fill out with numbers in range [0, mod). Faster than Fill(out, mod), but
+     * the generated sequence is different: the raw blocks are generated in
+     * bulk, and rejected values are replaced from after the batch.
+     */
+    template <typename U>
+    std::enable_if_t<std::is_integral_v<U>>
+    GenN(MakeUnsignedBoolT<U> mod, Span<U> out) noexcept
+    {
+      if (mod < 2)
+      {
+        std::fill(out.begin(), out.end(), U(0));
+        return;
+      }
+      LIBSHIT_ASSERT(mod <= std::numeric_limits<T>::max());
+      T tmod = mod;
+      T threshold = T(-tmod) % tmod;
+      FillConvert(out, [&](T g)
+      {
+        T hi, lo;
+        Detail::MulWide(g, tmod, hi, lo);
+        while (lo < threshold)
+          Detail::MulWide(
+            static_cast<Derived*>(this)->GenBlock(), tmod, hi, lo);
+        return static_cast<U>(hi);
+      });
+    }
+
+    /// Random permutation of s (Fisher-Yates shuffle).
+    template <typename U>
+    void Shuffle(Span<U> s)
+      noexcept(std::is_nothrow_swappable_v<U>)
+    {
+      LIBSHIT_ASSERT(s.size() <= std::numeric_limits<T>::max());
+      using std::swap;
+      for (auto i = s.size(); i > 1; --i)
+        swap(s[i-1], s[Bounded(static_cast<Derived*>(this)->GenBlock(), T(i))]);
+    }
+
+  private:
+    /**
+     * Lemire's nearly divisionless method: map g to [0, mod) with a
+     * multiplication, and only compute the rejection threshold (a division)
+     * when the low part is small enough that g might need to be rejected.
+     * <https://arxiv.org/abs/1805.10941>
+     */
+    constexpr T Bounded(T g, T mod) noexcept
+    {
+      T hi, lo;
+      Detail::MulWide(g, mod, hi, lo);
+      if (lo < mod)
+      {
+        T threshold = T(-mod) % mod;
+        while (lo < threshold)
+          Detail::MulWide(
+            static_cast<Derived*>(this)->GenBlock(), mod, hi, lo);
+      }
+      return hi;
+    }
+
+    template <typename U>
+    static constexpr std::enable_if_t<std::is_integral_v<U>, U>
+    FromBlock(T g) noexcept
+    {
+      static_assert(Bits<U>::value <= Bits<T>::value);
+      return g >> (Bits<T>::value - Bits<U>::value);
+    }
+
+    template <typename U>
+    static constexpr std::enable_if_t<std::is_floating_point_v<U>, U>
+    FromBlock(T g, U mul) noexcept
     {
       static_assert(sizeof(U) <= sizeof(T));
-      T g = static_cast<Derived*>(this)->GenBlock();
       constexpr auto dig = std::numeric_limits<U>::digits;
       return (g >> (sizeof(T)*CHAR_BIT - dig)) * (mul / (T(1)<<dig));
     }
+
+    template <typename U, typename Fun>
+    void FillConvert(Span<U> out, Fun f) noexcept
+    {
+      constexpr std::size_t CHUNK = 64;
+      T buf[CHUNK];
+      auto p = out.data();
+      for (auto n = out.size(); n; )
+      {
+        auto m = std::min<std::size_t>(n, CHUNK);
+        static_cast<Derived*>(this)->FillBlocks({buf, m});
+        for (std::size_t i = 0; i < m; ++i) p[i] = f(buf[i]);
+        p += m; n -= m;
+      }
+    }
   };
 
   /**
@@ -155,6 +321,33 @@ namespace Libshit
     Rand* rnd;
   };
 
+  namespace Detail
+  {
+    /// Jump polynomials from the reference implementations.
+    template <typename T, std::size_t Shift, std::size_t Rot>
+    struct XoshiroJumps;
+
+    template <> struct XoshiroJumps<std::uint32_t, 9, 11>
+    {
+      // 2^64 and 2^96 steps
+      static constexpr std::array<std::uint32_t, 4> JUMP{
+        0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b};
+      static constexpr std::array<std::uint32_t, 4> LONG_JUMP{
+        0xb523952e, 0x0b6f099f, 0xccf5a0ef, 0x1c580662};
+    };
+
+    template <> struct XoshiroJumps<std::uint64_t, 17, 45>
+    {
+      // 2^128 and 2^192 steps
+      static constexpr std::array<std::uint64_t, 4> JUMP{
+        0x180ec6d33cfd0aba, 0xd5a61266f0c9392c,
+        0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+      static constexpr std::array<std::uint64_t, 4> LONG_JUMP{
+        0x76e15d3efefdcbbf, 0xc5004e441c522fb3,
+        0x77710069854ee241, 0x39109bb02acbe635};
+    };
+  }
+
   /**
    * Random generator based on `xoshiro128+` implementation at
    * <http://xoshiro.di.unimi.it/xoshiro128plus.c>.
@@ -176,14 +369,67 @@ namespace Libshit
     constexpr Xoshirop(const std::array<T, 4>& state) noexcept
       : state{state}
     {
-      LIBSHIT_RASSERT(std::all_of(state.begin(), state.end(),
-                                  [](auto x) { return x > 0; }));
+      LIBSHIT_RASSERT(std::any_of(state.begin(), state.end(),
+                                  [](auto x) { return x != 0; }));
     }
 
     Xoshirop(const Xoshirop&) = delete;
     void operator=(const Xoshirop&) = delete;
 
-    constexpr T GenBlock() noexcept
+    constexpr const std::array<T, 4>& GetState() const noexcept
+    { return state; }
+
+    constexpr T GenBlock() noexcept { return Step(state); }
+
+    /**
+     * Advance the generator by 2^64 (xoshiro128+) or 2^128 (xoshiro256+)
+     * steps, as if GenBlock was called that many times.
+     */
+    constexpr void Jump() noexcept
+    { DoJump(Detail::XoshiroJumps<T, Shift, Rot>::JUMP); }
+
+    /// Advance the generator by 2^96 (xoshiro128+) or 2^192 (xoshiro256+) steps.
+    constexpr void LongJump() noexcept
+    { DoJump(Detail::XoshiroJumps<T, Shift, Rot>::LONG_JUMP); }
+
+    /**
+     * Return a generator starting from the current state, and Jump() this one.
+     * Generators returned by subsequent Split calls produce non-overlapping
+     * sequences (of length 2^64/2^128), so giving each worker thread the
+     * result of one Split() call gives reproducible results, independent of
+     * scheduling. Use LongJump() on the parent to create groups of workers.
+     */
+    constexpr Xoshirop Split() noexcept
+    {
+      auto st = state;
+      Jump();
+      return Xoshirop{st};
+    }
+
+    constexpr void FillBlocks(Span<T> out) noexcept
+    {
+      // work on a local copy, otherwise the compiler has to assume that out
+      // aliases state
+      auto st = state;
+      for (auto& x : out) x = Step(st);
+      state = st;
+    }
+
+  private:
+    constexpr void DoJump(const std::array<T, 4>& poly) noexcept
+    {
+      std::array<T, 4> res{};
+      for (auto p : poly)
+        for (std::size_t b = 0; b < Bits<T>::value; ++b)
+        {
+          if (p & (T(1) << b))
+            for (std::size_t i = 0; i < 4; ++i) res[i] ^= state[i];
+          Step(state);
+        }
+      state = res;
+    }
+
+    static constexpr T Step(std::array<T, 4>& state) noexcept
     {
       const T result_plus = state[0] + state[3];
 
@@ -196,20 +442,133 @@ namespace Libshit
 
       state[2] ^= t;
 
-      state[3] = rotl(state[3], Rot);
+      state[3] = Detail::Rotl(state[3], Rot);
 
       return result_plus;
     }
 
-  private:
-    static constexpr inline T rotl(T x, std::size_t k) noexcept
-    { return (x << k) | (x >> (Bits<T>::value - k)); }
-
     std::array<T, 4> state;
   };
 
   using Xoshiro128p = Xoshirop<std::uint32_t, 9, 11>;
   using Xoshiro256p = Xoshirop<std::uint64_t, 17, 45>;
+
+  /**
+   * Lanes independent Xoshirop streams advanced together. The state is stored
+   * lane-interleaved, so stepping all lanes at once is a simple loop the
+   * compiler can vectorize (SSE2/NEON with the default flags, AVX2 with
+   * -mavx2). GenBlock returns the lanes' outputs in order: lane 0..Lanes-1 of
+   * the first step, then of the second step, etc., so lane i on its own gives
+   * the same sequence as a Xoshirop seeded with that lane's state.
+   *
+   * Useful when a lot of random numbers are needed at once (Fill). For
+   * generating single values, use Xoshirop.
+   */
+  template <typename T, std::size_t Shift, std::size_t Rot, std::size_t Lanes>
+  class XoshiropLanes
+    : public RandomGeneratorBase<T, XoshiropLanes<T, Shift, Rot, Lanes>>
+  {
+  public:
+    static constexpr std::size_t LANES = Lanes;
+    using Seed = std::array<std::array<T, 4>, Lanes>;
+
+    XoshiropLanes() noexcept : XoshiropLanes{RandomSeed()} {}
+
+    /// Seed the lanes with Lanes subsequent Split() calls of parent, so they
+    /// don't overlap.
+    explicit XoshiropLanes(Xoshirop<T, Shift, Rot>& parent) noexcept
+      : XoshiropLanes{SplitSeed(parent)} {}
+
+    /// Every lane's state must be seeded so that it is not everywhere zero.
+    XoshiropLanes(const Seed& seed) noexcept
+    {
+      for (std::size_t i = 0; i < Lanes; ++i)
+      {
+        LIBSHIT_RASSERT(std::any_of(seed[i].begin(), seed[i].end(),
+                                    [](auto x) { return x != 0; }));
+        for (std::size_t j = 0; j < 4; ++j) state[j][i] = seed[i][j];
+      }
+    }
+
+    XoshiropLanes(const XoshiropLanes&) = delete;
+    void operator=(const XoshiropLanes&) = delete;
+
+    T GenBlock() noexcept
+    {
+      if (idx == Lanes) { Step(state, buf); idx = 0; }
+      return buf[idx++];
+    }
+
+    void FillBlocks(Span<T> out) noexcept
+    {
+      auto p = out.data();
+      auto n = out.size();
+      for (; n && idx < Lanes; --n) *p++ = buf[idx++];
+
+      auto st = state;
+      for (; n >= Lanes; n -= Lanes, p += Lanes) Step(st, p);
+      state = st;
+
+      if (n)
+      {
+        Step(state, buf);
+        for (idx = 0; idx < n; ++idx) p[idx] = buf[idx];
+      }
+    }
+
+  private:
+    using State = std::array<std::array<T, Lanes>, 4>;
+
+    static Seed SplitSeed(Xoshirop<T, Shift, Rot>& parent) noexcept
+    {
+      Seed seed;
+      for (auto& s : seed) s = parent.Split().GetState();
+      return seed;
+    }
+
+    static Seed RandomSeed() noexcept
+    {
+      Seed seed;
+      do
+        FillRandom({reinterpret_cast<std::byte*>(seed.data()), sizeof(seed)});
+      while (std::any_of(seed.begin(), seed.end(), [](const auto& s)
+      {
+        return std::all_of(s.begin(), s.end(), [](auto x) { return x == 0; });
+      }));
+      return seed;
+    }
+
+    static void Step(State& s, T* out) noexcept
+    {
+      for (std::size_t i = 0; i < Lanes; ++i)
+      {
+        out[i] = s[0][i] + s[3][i];
+        const T t = s[1][i] << Shift;
+        s[2][i] ^= s[0][i];
+        s[3][i] ^= s[1][i];
+        s[1][i] ^= s[2][i];
+        s[0][i] ^= s[3][i];
+        s[2][i] ^= t;
+        s[3][i] = Detail::Rotl(s[3][i], Rot);
+      }
+    }
+
+    alignas(sizeof(T) * Lanes) State state;
+    T buf[Lanes];
+    std::size_t idx = Lanes;
+  };
+
+  /**
+   * Get a generator local to the calling thread. They're seeded by Split() from
+   * a single, randomly seeded generator, so only the first call in the process
+   * needs the OS's random source.
+   */
+  Xoshiro256p& ThreadRandom() noexcept;
+
+  /// 8 xoshiro128+ streams (one AVX2 register per state word)
+  using Xoshiro128pX8 = XoshiropLanes<std::uint32_t, 9, 11, 8>;
+  /// 4 xoshiro256+ streams
+  using Xoshiro256pX4 = XoshiropLanes<std::uint64_t, 17, 45, 4>;
 }
 
 #endif
@@ -0,0 +1,64 @@
+#ifndef GUARD_NONVOLATILELY_SIXFOLD_BYTE_UNWRAPS_0916
+#define GUARD_NONVOLATILELY_SIXFOLD_BYTE_UNWRAPS_0916
+#pragma once
+
+// Small helpers for the hand vectorized string functions. SSE2 is part of the
+// x86_64 baseline so it's used without runtime dispatch, everywhere else use
+// 8 byte SWAR (SIMD within a register) words.
+
+#include "libshit/assert.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#if !defined(LIBSHIT_HAS_SSE2)
+#  if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define LIBSHIT_HAS_SSE2 1
+#  else
+#    define LIBSHIT_HAS_SSE2 0
+#  endif
+#endif
+
+#if LIBSHIT_HAS_SSE2
+#  include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+namespace Libshit::Simd
+{
+
+  inline unsigned CountTrailingZeros(std::uint32_t x) noexcept
+  {
+    LIBSHIT_ASSERT(x);
+#ifdef _MSC_VER
+    unsigned long res;
+    _BitScanForward(&res, x);
+    return res;
+#else
+    return __builtin_ctz(x);
+#endif
+  }
+
+  template <typename T>
+  inline std::uint64_t Load8(const T* p) noexcept
+  {
+    std::uint64_t res;
+    std::memcpy(&res, p, 8);
+    return res;
+  }
+
+  inline constexpr std::uint64_t ONES8 = 0x0101010101010101;
+  inline constexpr std::uint64_t HIGH8 = 0x80 * ONES8;
+
+#if LIBSHIT_HAS_SSE2
+  template <typename T>
+  inline __m128i Load16(const T* p) noexcept
+  { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+#endif
+
+}
+
+#endif
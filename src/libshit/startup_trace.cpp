@@ -0,0 +1,180 @@
+#include "libshit/startup_trace.hpp"
+
+#if LIBSHIT_STARTUP_TRACE
+
+#include "libshit/logger.hpp"
+#include "libshit/options.hpp"
+#include "libshit/utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+#include "libshit/doctest.hpp"
+
+namespace Libshit::StartupTrace
+{
+  TEST_SUITE_BEGIN("Libshit::StartupTrace");
+
+  namespace
+  {
+    // used from static initializers of other translation units, so it must be
+    // constructed on first use
+    struct Trace
+    {
+      std::mutex mutex;
+      std::vector<Entry> entries;
+      Clock::time_point last = Clock::now();
+    };
+  }
+
+  static Trace& GetTrace() noexcept
+  {
+    static Trace trace;
+    return trace;
+  }
+
+  // constant initialized, so it works in static initializers
+  static std::atomic<bool> stopped{false};
+  // just in case Stop is never called
+  static constexpr std::size_t MAX_ENTRIES = 16384;
+
+  static void Push(Trace& t, Entry e) noexcept
+  {
+    if (t.entries.size() >= MAX_ENTRIES) return;
+    // losing an entry is better than terminating before main
+    try { t.entries.push_back(e); } catch (...) {}
+  }
+
+  void Mark(const char* kind, const char* name) noexcept
+  {
+    if (stopped.load(std::memory_order_relaxed)) return;
+    auto now = Clock::now();
+    auto& t = GetTrace();
+    std::lock_guard lock{t.mutex};
+    Push(t, {kind, name, now - t.last});
+    t.last = now;
+  }
+
+  void Add(const char* kind, const char* name, Clock::time_point start,
+           Clock::time_point end) noexcept
+  {
+    if (stopped.load(std::memory_order_relaxed)) return;
+    auto& t = GetTrace();
+    std::lock_guard lock{t.mutex};
+    Push(t, {kind, name, end - start});
+    t.last = end;
+  }
+
+  void Stop() noexcept { stopped.store(true, std::memory_order_relaxed); }
+
+  std::vector<Entry> GetEntries()
+  {
+    std::vector<Entry> res;
+    {
+      auto& t = GetTrace();
+      std::lock_guard lock{t.mutex};
+      res = t.entries;
+    }
+    std::stable_sort(res.begin(), res.end(), [](const Entry& a, const Entry& b)
+                     { return a.duration > b.duration; });
+    return res;
+  }
+
+  void Dump(std::ostream& os, std::size_t count)
+  {
+    auto entries = GetEntries();
+    std::chrono::nanoseconds total{};
+    for (const auto& e : entries) total += e.duration;
+
+    auto flags = os.flags();
+    os << std::fixed << std::setprecision(3)
+       << "startup trace: " << entries.size() << " events, "
+       << total.count() / 1e6 << " ms total (nested scopes counted twice)\n"
+       << std::setw(12) << "ms" << "  " << std::left << std::setw(16) << "kind"
+       << "name\n";
+    for (std::size_t i = 0; i < entries.size() && i < count; ++i)
+    {
+      const auto& e = entries[i];
+      os << std::right << std::setw(12) << e.duration.count() / 1e6 << "  "
+         << std::left << std::setw(16) << e.kind
+         << (e.name ? e.name : "-") << '\n';
+    }
+    os.flags(flags);
+  }
+
+  static std::size_t dump_count;
+  static Option startup_trace_opt{
+    Logger::GetOptionGroup(), "startup-trace", 1, "COUNT",
+    "Print the COUNT slowest steps of the program startup at exit",
+    [](auto&, auto&& args)
+    {
+      auto str = args.front();
+      auto end = str + std::strlen(str);
+      auto res = std::from_chars(str, end, dump_count);
+      if (res.ec != std::errc() || res.ptr != end)
+        throw InvalidParam{"Invalid count"};
+
+      static bool registered = false;
+      if (!registered)
+        std::atexit([]() { Dump(std::clog, dump_count); });
+      registered = true;
+    }};
+
+  TEST_CASE("StartupTrace")
+  {
+    // other tests run the option parser
+    stopped = false;
+    AtScopeExit x{[]() { stopped = true; }};
+    auto count = GetEntries().size();
+    Mark("test", "mark");
+    {
+      Scope s{"test", "scope"};
+      Scope s2{"test", nullptr};
+    }
+
+    auto entries = GetEntries();
+    REQUIRE(entries.size() == count + 3);
+    auto find = [&](const char* name)
+    {
+      return std::find_if(
+        entries.begin(), entries.end(), [&](const Entry& e)
+        {
+          return !strcmp(e.kind, "test") &&
+            (e.name == name || (e.name && name && !strcmp(e.name, name)));
+        });
+    };
+    REQUIRE(find("mark") != entries.end());
+    REQUIRE(find("scope") != entries.end());
+    REQUIRE(find(nullptr) != entries.end());
+    CHECK(find("scope")->duration >= find(nullptr)->duration);
+    CHECK(std::is_sorted(
+            entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+            { return a.duration > b.duration; }));
+
+    std::stringstream ss;
+    Dump(ss, 0);
+    CHECK(ss.str().find("kind") != std::string::npos);
+    CHECK(ss.str().find("scope\n") == std::string::npos);
+
+    ss.str("");
+    Dump(ss, entries.size());
+    CHECK(ss.str().find("scope\n") != std::string::npos);
+    CHECK(ss.str().find("test            -\n") != std::string::npos);
+
+    Stop();
+    Mark("test", "stopped");
+    { Scope s{"test", "stopped"}; }
+    CHECK(GetEntries().size() == entries.size());
+  }
+
+  TEST_SUITE_END();
+}
+
+#endif
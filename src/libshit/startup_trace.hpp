@@ -0,0 +1,113 @@
+#ifndef GUARD_PREMATURELY_TICKING_REGISTRAR_OVERSLEEPS_4417
+#define GUARD_PREMATURELY_TICKING_REGISTRAR_OVERSLEEPS_4417
+#pragma once
+
+#ifndef LIBSHIT_STARTUP_TRACE
+#  define LIBSHIT_STARTUP_TRACE 0
+#endif
+
+#if LIBSHIT_STARTUP_TRACE
+
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#if LIBSHIT_WITH_TRACY
+#  include <Tracy.hpp>
+#endif
+
+#endif
+
+/**
+ * Optional trace of the process startup: static registrations (options,
+ * option groups, State::Register callbacks, logger initialization) and lua
+ * type registrations. Enable with LIBSHIT_STARTUP_TRACE=1 (`--startup-trace`
+ * at configure time), and get a report of the slowest steps with the
+ * `--startup-trace` command line option. Otherwise Scope is an empty struct
+ * and everything compiles to nothing.
+ */
+namespace Libshit::StartupTrace
+{
+  inline constexpr bool ENABLED = LIBSHIT_STARTUP_TRACE;
+
+#if LIBSHIT_STARTUP_TRACE
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * Record a registration. Static initializers can't be measured one by one,
+   * so the time since the end of the previous event is attributed to it: this
+   * is the time spent initializing everything between the two registrations.
+   */
+  void Mark(const char* kind, const char* name) noexcept;
+
+  void Add(const char* kind, const char* name, Clock::time_point start,
+           Clock::time_point end) noexcept;
+
+  /**
+   * End of the startup, later events are ignored (lua states and threads can
+   * be created during the whole lifetime of the program). Called when
+   * OptionParser::Run finishes.
+   */
+  void Stop() noexcept;
+
+#if LIBSHIT_WITH_TRACY
+  inline constexpr tracy::SourceLocationData TRACY_LOC{
+    nullptr, "startup", __FILE__, __LINE__, 0};
+#endif
+
+  /// Measure everything between construction and destruction.
+  class Scope
+  {
+  public:
+    Scope(const char* kind, const char* name) noexcept
+      : kind{kind}, name{name}, start{Clock::now()}
+#if LIBSHIT_WITH_TRACY
+      , zone{&TRACY_LOC}
+#endif
+    {
+#if LIBSHIT_WITH_TRACY
+      auto zone_name = name ? name : kind;
+      zone.Name(zone_name, std::char_traits<char>::length(zone_name));
+#endif
+    }
+    Scope(const Scope&) = delete;
+    void operator=(const Scope&) = delete;
+    ~Scope() noexcept { Add(kind, name, start, Clock::now()); }
+
+  private:
+    const char* kind;
+    const char* name;
+    Clock::time_point start;
+#if LIBSHIT_WITH_TRACY
+    tracy::ScopedZone zone;
+#endif
+  };
+
+  struct Entry
+  {
+    const char* kind;
+    const char* name;
+    std::chrono::nanoseconds duration;
+  };
+
+  /// Get a snapshot of all events, sorted by decreasing duration.
+  std::vector<Entry> GetEntries();
+  /// Print the `count` slowest events.
+  void Dump(std::ostream& os, std::size_t count);
+
+#else
+  inline void Mark(const char*, const char*) noexcept {}
+  inline void Stop() noexcept {}
+
+  struct Scope
+  {
+    Scope(const char*, const char*) noexcept {}
+    Scope(const Scope&) = delete;
+    void operator=(const Scope&) = delete;
+  };
+#endif
+}
+
+#endif
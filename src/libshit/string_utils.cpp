@@ -2,11 +2,14 @@
 
 #include "libshit/char_utils.hpp"
 #include "libshit/doctest.hpp"
+#include "libshit/simd_utils.hpp"
 
 #include <algorithm>
 #include <cctype>
 #include <climits>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <ostream>
 
@@ -115,6 +118,41 @@ namespace Libshit
     return res;
   }
 
+  TEST_CASE("Cat")
+  {
+    CHECK(Cat({"foo", "bar"}) == "foobar");
+    CHECK(Cat("foo", 12, '/', -3, "x"_ns, std::string{"str"}) ==
+          "foo12/-3xstr");
+    CHECK(Cat(1.5, ' ', 0.1f, ' ', 0.25L) == "1.5 0.1 0.25");
+
+    // the fallback of toolchains without floating point to_chars
+    auto fallback = [](auto t)
+    {
+      char buf[64];
+      return std::string(buf, Detail::SnprintfShortest(buf, sizeof(buf), t));
+    };
+    CHECK(fallback(0.1f) == "0.1");
+    CHECK(fallback(0.1) == "0.1");
+    CHECK(fallback(1.5L) == "1.5");
+    CHECK(fallback(1.0 / 3) == "0.3333333333333333");
+    CHECK(fallback(16777217.f) == "16777216");
+    CHECK(Cat(static_cast<unsigned char>(65), StringView{"abc", 2}) == "65ab");
+
+    std::string long_str(300, 'x');
+    CHECK(Cat(long_str, 1) == long_str + "1");
+
+    std::string out = "a";
+    FormatTo(out, "b", 2, 'c');
+    FormatTo(out);
+    CHECK(out == "ab2c");
+
+    char buf[4];
+    CHECK(ToChars(buf, buf+4, 1234) == buf+4);
+    CHECK(StringView(buf, 4) == "1234");
+    CHECK(ToChars(buf, buf+4, 12345) == nullptr);
+    CHECK(ToChars(buf, buf+2, "abc") == nullptr);
+  }
+
   // no std:: because there's no std::isascii
   // isascii isn't standard C
   TEST_CASE("ctype.h test")
@@ -165,9 +203,54 @@ namespace Libshit
 
   namespace Ascii
   {
+    using Simd::CountTrailingZeros;
+    using Simd::Load8;
+#if LIBSHIT_HAS_SSE2
+    using Simd::Load16;
+
+    static __m128i Fold16(__m128i x) noexcept
+    {
+      // signed compare: bytes >= 0x80 are negative, never upper case
+      auto upper = _mm_and_si128(
+        _mm_cmpgt_epi8(x, _mm_set1_epi8('A'-1)),
+        _mm_cmplt_epi8(x, _mm_set1_epi8('Z'+1)));
+      return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+    }
+#endif
+
+    static std::uint64_t Fold8(std::uint64_t w) noexcept
+    {
+      using Simd::ONES8; using Simd::HIGH8;
+      auto low7 = w & ~HIGH8;
+      // high bit set in bytes where low7 >= 'A' and low7 > 'Z' respectively
+      auto ge_a = low7 + (0x80 - 'A') * ONES8;
+      auto gt_z = low7 + (0x7f - 'Z') * ONES8;
+      auto upper = ~w & (ge_a ^ gt_z) & HIGH8;
+      return w | (upper >> 2);
+    }
+
     int CaseCmp(StringView a, StringView b) noexcept
     {
-      for (std::size_t i = 0, n = std::min(a.size(), b.size()); i < n; ++i)
+      std::size_t i = 0, n = std::min(a.size(), b.size());
+#if LIBSHIT_HAS_SSE2
+      for (; i + 16 <= n; i += 16)
+      {
+        auto eq = _mm_cmpeq_epi8(Fold16(Load16(a.data() + i)),
+                                 Fold16(Load16(b.data() + i)));
+        unsigned ne = _mm_movemask_epi8(eq) ^ 0xffff;
+        if (ne)
+        {
+          i += CountTrailingZeros(ne);
+          return static_cast<unsigned char>(ToLower(a[i])) -
+            static_cast<unsigned char>(ToLower(b[i]));
+        }
+      }
+#endif
+      // on mismatch the scalar loop below finds the exact position
+      for (; i + 8 <= n; i += 8)
+        if (Fold8(Load8(a.data() + i)) != Fold8(Load8(b.data() + i))) break;
+
+      for (; i < n; ++i)
       {
         auto la = static_cast<unsigned char>(ToLower(a[i]));
         auto lb = static_cast<unsigned char>(ToLower(b[i]));
@@ -192,12 +275,86 @@ namespace Libshit
       CHECK(CaseCmp("brütal", "BRÜTAL") > 0); // unicode not supported
     }
 
+    std::size_t CaseHash::Hash(StringView str) noexcept
+    {
+      // multiply-xorshift over folded 8 byte words
+      constexpr std::uint64_t K = 0x9e3779b97f4a7c15;
+      auto mix = [](std::uint64_t h, std::uint64_t w)
+      {
+        h = (h ^ w) * K;
+        return h ^ (h >> 32);
+      };
+
+      std::uint64_t h = K ^ str.size();
+      std::size_t i = 0, n = str.size();
+      for (; i + 8 <= n; i += 8) h = mix(h, Fold8(Load8(str.data() + i)));
+      if (i < n)
+      {
+        std::uint64_t w = 0;
+        std::memcpy(&w, str.data() + i, n - i);
+        h = mix(h, Fold8(w));
+      }
+
+      h ^= h >> 29;
+      h *= 0xbf58476d1ce4e5b9;
+      return static_cast<std::size_t>(h ^ (h >> 32));
+    }
+
+    TEST_CASE("CaseHash")
+    {
+      CaseHash h;
+      CHECK(h("") == h(""));
+      CHECK(h("abc") == h("ABC"));
+      CHECK(h("Hello, World! Long string 123") ==
+            h("hELLO, wORLD! lONG STRING 123"));
+      CHECK(h("abc") != h("abd"));
+      CHECK(h("a") != h(StringView{"a\0", 2}));
+      CHECK(h("@") != h("`"));
+
+      CaseUnorderedMap<int> map;
+      map["Foo"] = 1;
+      map["BAR"] = 2;
+      CHECK(map.size() == 2);
+      CHECK(map.at("foo") == 1);
+      CHECK(map.at("bar") == 2);
+      map["FOO"] = 3;
+      CHECK(map.size() == 2);
+      CHECK(map.at("Foo") == 3);
+      CHECK(map.count("baz") == 0);
+    }
+
     std::size_t CaseFind(StringView str, StringView to_search) noexcept
     {
-      if (to_search.size() > str.size()) return StringView::npos;
-      auto n = str.size() - to_search.size() + 1;
-      for (std::size_t i = 0; i < n; ++i)
-        if (!CaseCmp(str.substr(i, to_search.size()), to_search))
+      auto m = to_search.size();
+      if (m == 0) return 0;
+      if (m > str.size()) return StringView::npos;
+
+      // only check positions where the first and last characters match
+      auto first = ToLower(to_search[0]), last = ToLower(to_search[m-1]);
+      auto rest = to_search.substr(1);
+      auto last_pos = str.size() - m;
+      std::size_t i = 0;
+
+#if LIBSHIT_HAS_SSE2
+      auto vfirst = _mm_set1_epi8(first), vlast = _mm_set1_epi8(last);
+      for (; i + 16 <= last_pos + 1; i += 16)
+      {
+        auto eq = _mm_and_si128(
+          _mm_cmpeq_epi8(Fold16(Load16(str.data() + i)), vfirst),
+          _mm_cmpeq_epi8(Fold16(Load16(str.data() + i + m - 1)), vlast));
+        unsigned mask = _mm_movemask_epi8(eq);
+        while (mask)
+        {
+          auto pos = i + CountTrailingZeros(mask);
+          if (!CaseCmp(str.substr(pos + 1, m - 1), rest)) return pos;
+          mask &= mask - 1;
+        }
+      }
+#endif
+
+      for (; i <= last_pos; ++i)
+        if (ToLower(str[i]) == first && ToLower(str[i+m-1]) == last &&
+            !CaseCmp(str.substr(i + 1, m - 1), rest))
           return i;
       return StringView::npos;
     }
@@ -211,6 +368,60 @@ namespace Libshit
       CHECK(CaseFind("abc", "") == 0);
       CHECK(CaseFind("abc", "x") == StringView::npos);
       CHECK(CaseFind("abc", "abcd") == StringView::npos);
+      CHECK(CaseFind("xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxFOObar", "fooBAR") == 32);
+      CHECK(CaseFind("xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxfoobaz", "fooBAR") ==
+            StringView::npos);
+    }
+
+    TEST_CASE("CaseCmp/CaseFind match naive implementation")
+    {
+      auto naive_cmp = [](StringView a, StringView b)
+      {
+        for (std::size_t i = 0, n = std::min(a.size(), b.size()); i < n; ++i)
+        {
+          auto la = static_cast<unsigned char>(ToLower(a[i]));
+          auto lb = static_cast<unsigned char>(ToLower(b[i]));
+          if (la != lb) return la - lb;
+        }
+        return a.size() < b.size() ? -1 : a.size() == b.size() ? 0 : 1;
+      };
+      auto naive_find = [&](StringView str, StringView to_search)
+      {
+        if (to_search.size() > str.size()) return StringView::npos;
+        for (std::size_t i = 0; i <= str.size() - to_search.size(); ++i)
+          if (!naive_cmp(str.substr(i, to_search.size()), to_search))
+            return i;
+        return StringView::npos;
+      };
+
+      // edge characters of the upper/lower case ranges and non-ascii bytes
+      static constexpr char CHARS[] = "aAzZbB@[`{\x80\xc1\xdaq";
+      std::uint32_t seed = 12345;
+      auto rnd = [&]() { seed = seed * 1664525 + 1013904223; return seed >> 8; };
+      auto gen = [&](std::size_t len, std::size_t nchars)
+      {
+        std::string res(len, ' ');
+        for (auto& c : res) c = CHARS[rnd() % nchars];
+        return res;
+      };
+
+      for (int i = 0; i < 2000; ++i)
+      {
+        auto a = gen(rnd() % 70, sizeof(CHARS) - 1);
+        auto b = a;
+        if (!b.empty() && rnd() % 2) b[rnd() % b.size()] = CHARS[rnd() % 14];
+        if (rnd() % 4 == 0) b.resize(rnd() % (b.size() + 1));
+        CAPTURE(a); CAPTURE(b);
+        auto sign = [](int x) { return (x > 0) - (x < 0); };
+        CHECK(sign(CaseCmp(a, b)) == sign(naive_cmp(a, b)));
+        if (!a.empty() && !b.empty())
+          CHECK(CaseCmp(a, b) == naive_cmp(a, b));
+
+        auto hay = gen(rnd() % 100, 4);
+        auto needle = gen(1 + rnd() % 4, 4);
+        CAPTURE(hay); CAPTURE(needle);
+        CHECK(CaseFind(hay, needle) == naive_find(hay, needle));
+      }
     }
   }
 
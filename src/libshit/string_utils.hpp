@@ -3,11 +3,14 @@
 #pragma once
 
 #include "libshit/nonowning_string.hpp"
+#include "libshit/to_chars.hpp"
 
 #include <cstddef>
 #include <initializer_list>
 #include <iosfwd>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
 
 namespace Libshit
 {
@@ -28,6 +31,32 @@ namespace Libshit
 
   std::string Cat(std::initializer_list<StringView> lst);
 
+  /**
+   * Concatenate strings, characters and numbers (anything with a
+   * ToCharsTraits) without temporary strings. Short results are built in a
+   * stack buffer, so only the returned string is allocated (if it doesn't fit
+   * into SSO).
+   */
+  template <typename... Args,
+            typename = std::enable_if_t<(HAS_TO_CHARS<Args> && ...)>>
+  inline std::string Cat(const Args&... args)
+  {
+    std::size_t max_size =
+      (std::size_t(0) + ... + ToCharsTraits<Args>::MaxSize(args));
+    if (max_size <= 256)
+    {
+      char buf[256];
+      char* p = buf;
+      ((p = ToCharsTraits<Args>::Write(p, args)), ...);
+      return {buf, p};
+    }
+
+    std::string res;
+    res.reserve(max_size);
+    FormatTo(res, args...);
+    return res;
+  }
+
   namespace Ascii
   {
     int CaseCmp(StringView a, StringView b) noexcept;
@@ -44,8 +73,24 @@ namespace Libshit
     LIBSHIT_GEN(EqualTo, ==); LIBSHIT_GEN(NotEqualTo,   !=);
 #undef LIBSHIT_GEN
 
-    /// Like StringView.find, except case insensitive.
-    /// @warning Naive algorithm (but normal find isn't better either)
+    /// Case insensitive hash, compatible with CaseEqualTo (strings that
+    /// compare equal have the same hash). Not stable between runs or builds.
+    struct CaseHash
+    {
+      using is_transparent = bool;
+      std::size_t operator()(StringView str) const noexcept
+      { return Hash(str); }
+      static std::size_t Hash(StringView str) noexcept;
+    };
+
+    /// Case insensitive std::unordered_map with std::string keys.
+    template <typename T>
+    using CaseUnorderedMap =
+      std::unordered_map<std::string, T, CaseHash, CaseEqualTo>;
+
+    /// Like StringView.find, except case insensitive. Only positions where
+    /// the first and last characters match are checked (16 at a time with
+    /// SSE2).
     std::size_t CaseFind(StringView str, StringView to_search) noexcept;
 
     inline bool CaseContains(StringView str, StringView to_search) noexcept
@@ -0,0 +1,173 @@
+#ifndef GUARD_UNSHRINKINGLY_DIGITAL_FIGURINE_OVERSPELLS_7102
+#define GUARD_UNSHRINKINGLY_DIGITAL_FIGURINE_OVERSPELLS_7102
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#if !defined(__cpp_lib_to_chars) && \
+  !(defined(_LIBCPP_VERSION) && _LIBCPP_VERSION >= 14000)
+#  define LIBSHIT_FLOAT_TO_CHARS 0
+#else
+#  define LIBSHIT_FLOAT_TO_CHARS 1
+#endif
+
+namespace Libshit
+{
+
+  /**
+   * Customization point of ToChars, Cat and FormatTo. Specializations must
+   * have:
+   * - `static std::size_t MaxSize(const T&) noexcept`: upper bound on the
+   *   number of characters written,
+   * - `static char* Write(char* out, const T&) noexcept`: write the value to
+   *   `out`, which has at least `MaxSize` free space, return the end pointer.
+   *
+   * Implemented for integers (printed as numbers), floating point numbers
+   * (shortest representation that round-trips), `char` (as a character) and
+   * strings.
+   */
+  template <typename T, typename Enable = void> struct ToCharsTraits;
+
+  template <typename T, typename = void>
+  inline constexpr bool HAS_TO_CHARS = false;
+  template <typename T>
+  inline constexpr bool HAS_TO_CHARS<
+    T, std::void_t<decltype(ToCharsTraits<T>::MaxSize(std::declval<T>()))>> =
+    true;
+
+  template <typename T>
+  struct ToCharsTraits<T, std::enable_if_t<
+    std::is_integral_v<T> && !std::is_same_v<T, bool> &&
+    !std::is_same_v<T, char>>>
+  {
+    static constexpr std::size_t MAX_SIZE =
+      std::numeric_limits<T>::digits10 + 2;
+    static constexpr std::size_t MaxSize(T) noexcept { return MAX_SIZE; }
+    static char* Write(char* out, T t) noexcept
+    { return std::to_chars(out, out + MAX_SIZE, t).ptr; }
+  };
+
+  namespace Detail
+  {
+    template <typename T> T StrTo(const char* str) noexcept
+    {
+      if constexpr (std::is_same_v<T, float>) return std::strtof(str, nullptr);
+      else if constexpr (std::is_same_v<T, double>)
+        return std::strtod(str, nullptr);
+      else return std::strtold(str, nullptr);
+    }
+
+    /**
+     * Shortest round-tripping representation with snprintf, for standard
+     * libraries without floating point to_chars: increase the precision until
+     * parsing it back gives the same value. `out` must have at least `size`
+     * free space.
+     */
+    template <typename T>
+    char* SnprintfShortest(char* out, std::size_t size, T t) noexcept
+    {
+      int n = 0;
+      for (int prec = std::numeric_limits<T>::digits10;
+           prec <= std::numeric_limits<T>::max_digits10; ++prec)
+      {
+        n = std::snprintf(
+          out, size, "%.*Lg", prec, static_cast<long double>(t));
+        if (n < 0) return out;
+        // NaN never compares equal, but it round-trips anyway
+        if (t != t || StrTo<T>(out) == t) break;
+      }
+      return out + n;
+    }
+  }
+
+  template <typename T>
+  struct ToCharsTraits<T, std::enable_if_t<std::is_floating_point_v<T>>>
+  {
+    // enough even for the longest 80/128-bit long double
+    static constexpr std::size_t MAX_SIZE = 64;
+    static constexpr std::size_t MaxSize(T) noexcept { return MAX_SIZE; }
+    static char* Write(char* out, T t) noexcept
+    {
+#if LIBSHIT_FLOAT_TO_CHARS
+      return std::to_chars(out, out + MAX_SIZE, t).ptr;
+#else
+      return Detail::SnprintfShortest(out, MAX_SIZE, t);
+#endif
+    }
+  };
+
+  template <>
+  struct ToCharsTraits<char>
+  {
+    static constexpr std::size_t MaxSize(char) noexcept { return 1; }
+    static char* Write(char* out, char c) noexcept
+    {
+      *out = c;
+      return out + 1;
+    }
+  };
+
+  template <typename T>
+  struct ToCharsTraits<T, std::enable_if_t<
+    std::is_convertible_v<const T&, std::string_view> &&
+    !std::is_same_v<T, char>>>
+  {
+    static std::size_t MaxSize(std::string_view sv) noexcept
+    { return sv.size(); }
+    static char* Write(char* out, std::string_view sv) noexcept
+    {
+      if (!sv.empty()) std::memcpy(out, sv.data(), sv.size());
+      return out + sv.size();
+    }
+  };
+
+  /**
+   * Write `t` to [first, last) without allocation.
+   * @return pointer past the last written character, or nullptr if it didn't
+   *   fit.
+   */
+  template <typename T>
+  inline char* ToChars(char* first, char* last, const T& t) noexcept
+  {
+    using Traits = ToCharsTraits<T>;
+    std::size_t avail = last - first;
+    if (Traits::MaxSize(t) <= avail) return Traits::Write(first, t);
+
+    // slow path: the value might still fit, the maximal size is only an
+    // estimate for numbers
+    if constexpr (std::is_arithmetic_v<T>)
+    {
+      char buf[Traits::MAX_SIZE];
+      auto end = Traits::Write(buf, t);
+      std::size_t n = end - buf;
+      if (n > avail) return nullptr;
+      std::memcpy(first, buf, n);
+      return first + n;
+    }
+    else
+      return nullptr;
+  }
+
+  /// Append every argument to `out`, with at most one reallocation.
+  template <typename... Args>
+  inline void FormatTo(std::string& out, const Args&... args)
+  {
+    auto old_size = out.size();
+    out.resize(old_size + (std::size_t(0) + ... +
+                           ToCharsTraits<Args>::MaxSize(args)));
+    auto p = out.data() + old_size;
+    ((p = ToCharsTraits<Args>::Write(p, args)), ...);
+    out.resize(p - out.data());
+  }
+
+}
+
+#endif
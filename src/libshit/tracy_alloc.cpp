@@ -2,15 +2,193 @@
 
 #include <Tracy.hpp>
 
+#include <atomic>
+#include <cstdint>
 #include <new>
 
 // Set to true if you want zones around new/delete
 static constexpr const bool ZONES = true;
 
+// Sampling: only report some of the allocations to tracy, everything else
+// just calls the original allocation functions, so it's usable on allocation
+// heavy programs. Zones are only created around sampled allocations.
+// Report every Nth allocation (per thread). 1: report everything.
+#ifndef LIBSHIT_TRACY_ALLOC_SAMPLE_EVERY
+#  define LIBSHIT_TRACY_ALLOC_SAMPLE_EVERY 1
+#endif
+// Report one allocation per about N allocated bytes (per thread), like heap
+// profilers do: allocations bigger than N are always reported. Overrides
+// SAMPLE_EVERY if not 0.
+#ifndef LIBSHIT_TRACY_ALLOC_SAMPLE_BYTES
+#  define LIBSHIT_TRACY_ALLOC_SAMPLE_BYTES 0
+#endif
+// Number of callstack frames (excluding the allocation function) captured on
+// reported allocations. 0: don't capture callstacks, much cheaper.
+#ifndef LIBSHIT_TRACY_ALLOC_CALLSTACK
+#  define LIBSHIT_TRACY_ALLOC_CALLSTACK 4
+#endif
+// Count allocations per size class in thread local counters and plot the
+// totals every N allocations of a thread (counts of exited threads since their
+// last flush are lost). 0: disable.
+#ifndef LIBSHIT_TRACY_ALLOC_FLUSH_EVERY
+#  define LIBSHIT_TRACY_ALLOC_FLUSH_EVERY 0
+#endif
+
+static constexpr const std::size_t SAMPLE_EVERY =
+  LIBSHIT_TRACY_ALLOC_SAMPLE_EVERY;
+static constexpr const std::size_t SAMPLE_BYTES =
+  LIBSHIT_TRACY_ALLOC_SAMPLE_BYTES;
+static constexpr const bool SAMPLING = SAMPLE_BYTES || SAMPLE_EVERY > 1;
+static constexpr const int CALLSTACK = LIBSHIT_TRACY_ALLOC_CALLSTACK;
+static constexpr const std::size_t FLUSH_EVERY =
+  LIBSHIT_TRACY_ALLOC_FLUSH_EVERY;
+
 #define NOT_ALLOCD_DEBUG 0
 
 using namespace Libshit; // we're placing shit into the global namespace here...
 
+static constexpr const char* const SIZE_CLASS_NAMES[] = {
+  "alloc <=16", "alloc <=32", "alloc <=64", "alloc <=128", "alloc <=256",
+  "alloc <=512", "alloc <=1k", "alloc <=2k", "alloc <=4k", "alloc <=8k",
+  "alloc <=16k", "alloc <=32k", "alloc <=64k", "alloc <=128k",
+  "alloc <=256k", "alloc <=512k", "alloc <=1M", "alloc >1M",
+};
+static constexpr const std::size_t SIZE_CLASSES =
+  sizeof(SIZE_CLASS_NAMES) / sizeof(SIZE_CLASS_NAMES[0]);
+
+namespace
+{
+  // only trivial types are allowed here, thread_local destructors can't run
+  // inside allocation functions
+  struct ThreadState
+  {
+    std::size_t countdown; // allocations/bytes until the next sample
+    std::uint64_t rng;
+    std::size_t allocs; // since the last flush
+    std::uint64_t bytes;
+    std::uint32_t counts[SIZE_CLASSES];
+  };
+  thread_local ThreadState thread_state;
+
+  // Pointers reported to tracy, so free only reports those. Allocations are
+  // only sampled if they fit into their bucket, a bucket is one cache line so
+  // a free only costs a single cache miss.
+  struct alignas(64) Bucket { std::atomic<void*> ptrs[8]; };
+  constexpr const unsigned BUCKET_BITS = SAMPLING ? 12 : 1;
+  Bucket sampled[1 << BUCKET_BITS];
+
+  std::atomic<std::uint64_t> global_counts[SIZE_CLASSES];
+  std::atomic<std::uint64_t> global_bytes;
+}
+
+static Bucket& GetBucket(void* ptr) noexcept
+{
+  auto h = (reinterpret_cast<std::uintptr_t>(ptr) >> 4) *
+    std::uint64_t(0x9e3779b97f4a7c15);
+  return sampled[h >> (64 - BUCKET_BITS)];
+}
+
+static bool InsertSampled(void* ptr) noexcept
+{
+  for (auto& p : GetBucket(ptr).ptrs)
+  {
+    void* exp = nullptr;
+    if (p.load(std::memory_order_relaxed) == nullptr &&
+        p.compare_exchange_strong(exp, ptr, std::memory_order_relaxed))
+      return true;
+  }
+  return false;
+}
+
+static bool EraseSampled(void* ptr) noexcept
+{
+  // the memory is only freed after this, so ptr can't be inserted again
+  // concurrently
+  for (auto& p : GetBucket(ptr).ptrs)
+    if (p.load(std::memory_order_relaxed) == ptr)
+    {
+      p.store(nullptr, std::memory_order_relaxed);
+      return true;
+    }
+  return false;
+}
+
+static void Flush(ThreadState& st) noexcept
+{
+  st.allocs = 0;
+  for (std::size_t i = 0; i < SIZE_CLASSES; ++i)
+    if (st.counts[i])
+    {
+      auto n = global_counts[i].fetch_add(
+        st.counts[i], std::memory_order_relaxed) + st.counts[i];
+      TracyPlot(SIZE_CLASS_NAMES[i], static_cast<std::int64_t>(n));
+      st.counts[i] = 0;
+    }
+  auto bytes = global_bytes.fetch_add(
+    st.bytes, std::memory_order_relaxed) + st.bytes;
+  TracyPlot("allocated bytes", static_cast<std::int64_t>(bytes));
+  st.bytes = 0;
+}
+
+// Count the allocation and decide whether it should be reported. Must be
+// called before allocating, so zones can be skipped on not sampled allocs.
+static bool SampleAlloc(std::size_t size) noexcept
+{
+  auto& st = thread_state;
+  if constexpr (FLUSH_EVERY != 0)
+  {
+    std::size_t cls = size <= 16 ? 0 : 60 - __builtin_clzll(size - 1);
+    ++st.counts[cls < SIZE_CLASSES ? cls : SIZE_CLASSES - 1];
+    st.bytes += size;
+    if (++st.allocs == FLUSH_EVERY) Flush(st);
+  }
+
+  if constexpr (SAMPLE_BYTES != 0)
+  {
+    if (st.countdown > size)
+    {
+      st.countdown -= size;
+      return false;
+    }
+    // randomize the interval (uniform in [N/2, 3N/2)), otherwise periodic
+    // allocation patterns could always sample the same allocation
+    if (!st.rng) st.rng = reinterpret_cast<std::uintptr_t>(&st) | 1;
+    st.rng ^= st.rng << 13; st.rng ^= st.rng >> 7; st.rng ^= st.rng << 17;
+    st.countdown = SAMPLE_BYTES / 2 + st.rng % SAMPLE_BYTES;
+    return true;
+  }
+  else if constexpr (SAMPLE_EVERY > 1)
+  {
+    if (st.countdown)
+    {
+      --st.countdown;
+      return false;
+    }
+    st.countdown = SAMPLE_EVERY - 1;
+    return true;
+  }
+  else
+    return true;
+}
+
+// frames: number of allocation related frames on the stack above the caller
+static void ReportAlloc(void* ptr, std::size_t size, int frames) noexcept
+{
+  if (!ptr) return;
+  if constexpr (SAMPLING) if (!InsertSampled(ptr)) return;
+  if constexpr (CALLSTACK > 0) TracyAllocS(ptr, size, CALLSTACK + frames);
+  else TracyAlloc(ptr, size);
+}
+
+static bool ReportFree(void* ptr, int frames) noexcept
+{
+  if (!ptr) return false;
+  if constexpr (SAMPLING) if (!EraseSampled(ptr)) return false;
+  if constexpr (CALLSTACK > 0) TracyFreeS(ptr, CALLSTACK + frames);
+  else TracyFree(ptr);
+  return true;
+}
+
 #if LIBSHIT_HAS_OVERRIDE_MALLOC
 #include <dlfcn.h>
 #include <malloc.h>
@@ -75,12 +253,12 @@ static void MarkAlloc(void* ptr, std::size_t size)
   if (!found) abort();
   pthread_mutex_unlock(&alloc_mutex);
 #endif
-  TracyAllocS(ptr, size, 6);
+  ReportAlloc(ptr, size, 3);
 }
 
-static void MarkFree(void* ptr)
+static bool MarkFree(void* ptr)
 {
-  if (!ptr) return;
+  if (!ptr) return false;
 #if NOT_ALLOCD_DEBUG
   pthread_mutex_lock(&alloc_mutex);
   for (std::size_t i = 0; i < MAX_ALLOCS; ++i)
@@ -89,8 +267,7 @@ static void MarkFree(void* ptr)
     {
       allocs[i] = nullptr;
       pthread_mutex_unlock(&alloc_mutex);
-      TracyFreeS(ptr, 6);
-      return;
+      return ReportFree(ptr, 3);
     }
   }
   pthread_mutex_unlock(&alloc_mutex);
@@ -101,13 +278,14 @@ static void MarkFree(void* ptr)
     {
       fprintf(stderr, "ignored size %zu\n", ignored_i);
       ignored_allocs[i] = nullptr;
-      return;
+      return false;
     }
 
 #if NOT_ALLOCD_DEBUG
   fprintf(stderr, "Freeing not allocd memory %d %p\n", ignored, ptr);
+  return false;
 #else
-  TracyFreeS(ptr, 6);
+  return ReportFree(ptr, 3);
 #endif
 }
 
@@ -122,8 +300,8 @@ void free(void* ptr)
     return;
   }
 
-  MarkFree(ptr);
-  ZoneNamedNC(x, "free", 0x003300, ZONES);
+  auto reported = MarkFree(ptr);
+  ZoneNamedNC(x, "free", 0x003300, ZONES && reported);
   orig_free(ptr);
 }
 
@@ -146,11 +324,13 @@ void free(void* ptr)
     }                                                                    \
                                                                          \
     inside_malloc = true;                                                \
+    auto sample = SampleAlloc(size_param);                               \
     {                                                                    \
-      ZoneNamedNC(x, #name, 0x330000, ZONES); ZoneValueV(x, size_param); \
+      ZoneNamedNC(x, #name, 0x330000, ZONES && sample);                  \
+      ZoneValueV(x, size_param);                                         \
       ptr = orig_##name call;                                            \
     }                                                                    \
-    MarkAlloc(ptr, size_param);                                          \
+    if (sample) MarkAlloc(ptr, size_param);                              \
     inside_malloc = false;                                               \
     return ptr;                                                          \
   }
@@ -166,14 +346,16 @@ ALLOC_LIKE(calloc, (size_t nmemb, size_t size), (nmemb, size), nmemb * size);
     /* To prevent race condition with another thread just allocing the   \
      * the ptr again, mark as freed here. In the unlikely situation of   \
      * running out memory, we re-mark as allocd below... */              \
-    MarkFree(ptr);                                                       \
+    auto reported = MarkFree(ptr);                                       \
+    auto sample = SampleAlloc(size_param);                               \
     void* res_ptr;                                                       \
     {                                                                    \
-      ZoneNamedNC(x, #name, 0x330000, ZONES); ZoneValueV(x, size_param); \
+      ZoneNamedNC(x, #name, 0x330000, ZONES && sample);                  \
+      ZoneValueV(x, size_param);                                         \
       res_ptr = orig_##name(ptr, UNPAREN call);                          \
     }                                                                    \
-    if (res_ptr) MarkAlloc(res_ptr, size_param);                         \
-    else if (ptr && (size_param) != 0) MarkAlloc(ptr, old_size);         \
+    if (res_ptr) { if (sample) MarkAlloc(res_ptr, size_param); }         \
+    else if (reported && (size_param) != 0) MarkAlloc(ptr, old_size);    \
     return res_ptr;                                                      \
   }
 
@@ -187,11 +369,13 @@ __attribute__((visibility("default")))
 int posix_memalign(void** ptr, size_t align, size_t size)
 {
   if (!LoadIfNeeded()) return ENOMEM;
+  auto sample = SampleAlloc(size);
   {
-    ZoneNamedNC(x, "posix_memalign", 0x330000, ZONES); ZoneValueV(x, size);
+    ZoneNamedNC(x, "posix_memalign", 0x330000, ZONES && sample);
+    ZoneValueV(x, size);
     if (int res = orig_posix_memalign(ptr, align, size)) return res;
   }
-  MarkAlloc(*ptr, size);
+  if (sample) MarkAlloc(*ptr, size);
   return 0;
 }
 
@@ -205,51 +389,55 @@ ALLOC_LIKE(pvalloc, (size_t size), (size), size);
 #if LIBSHIT_HAS_OVERRIDE_NEW
 void* operator new(std::size_t count)
 {
+  auto sample = SampleAlloc(count);
   void* ptr;
   {
-    ZoneNamedNC(x, "new", 0x330000, ZONES); ZoneValueV(x, count);
+    ZoneNamedNC(x, "new", 0x330000, ZONES && sample); ZoneValueV(x, count);
     ptr = orig_malloc(count);
   }
   if (!ptr) throw std::bad_alloc{};
 
-  TracyAllocS(ptr, count, 5);
+  if (sample) ReportAlloc(ptr, count, 2);
   return ptr;
 }
 
 void* operator new(std::size_t count, const std::nothrow_t&) noexcept
 {
+  auto sample = SampleAlloc(count);
   void* ptr;
   {
-    ZoneNamedNC(x, "new", 0x330000, ZONES); ZoneValueV(x, count);
+    ZoneNamedNC(x, "new", 0x330000, ZONES && sample); ZoneValueV(x, count);
     ptr = orig_malloc(count);
   }
-  TracyAllocS(ptr, count, 5);
+  if (sample) ReportAlloc(ptr, count, 2);
   return ptr;
 }
 
 #if !LIBSHIT_OS_IS_WINDOWS
 void* operator new(std::size_t count, std::align_val_t al)
 {
+  auto sample = SampleAlloc(count);
   void* ptr;
   {
-    ZoneNamedNC(x, "new", 0x330000, ZONES); ZoneValueV(x, count);
+    ZoneNamedNC(x, "new", 0x330000, ZONES && sample); ZoneValueV(x, count);
     if (orig_posix_memalign(&ptr, static_cast<std::size_t>(al), count))
       throw std::bad_alloc{};
   }
-  TracyAllocS(ptr, count, 5);
+  if (sample) ReportAlloc(ptr, count, 2);
   return ptr;
 }
 
 void* operator new(std::size_t count, std::align_val_t al,
                    const std::nothrow_t&) noexcept
 {
+  auto sample = SampleAlloc(count);
   void* ptr;
   {
-    ZoneNamedNC(x, "new", 0x330000, ZONES); ZoneValueV(x, count);
+    ZoneNamedNC(x, "new", 0x330000, ZONES && sample); ZoneValueV(x, count);
     if (orig_posix_memalign(&ptr, static_cast<std::size_t>(al), count))
       return nullptr;
   }
-  TracyAllocS(ptr, count, 5);
+  if (sample) ReportAlloc(ptr, count, 2);
   return ptr;
 }
 #endif
@@ -257,16 +445,16 @@ void* operator new(std::size_t count, std::align_val_t al,
 
 void operator delete(void* ptr) noexcept
 {
-  TracyFreeS(ptr, 5);
-  ZoneNamedNC(x, "delete", 0x003300, ZONES);
+  auto reported = ReportFree(ptr, 2);
+  ZoneNamedNC(x, "delete", 0x003300, ZONES && reported);
   orig_free(ptr);
 }
 
 #if !LIBSHIT_OS_IS_WINDOWS
 void operator delete(void* ptr, std::align_val_t al) noexcept
 {
-  TracyFreeS(ptr, 5);
-  ZoneNamedNC(x, "delete", 0x003300, ZONES);
+  auto reported = ReportFree(ptr, 2);
+  ZoneNamedNC(x, "delete", 0x003300, ZONES && reported);
   orig_free(ptr);
 }
 #endif
@@ -274,8 +462,8 @@ void operator delete(void* ptr, std::align_val_t al) noexcept
 void operator delete(void* ptr, std::size_t size) noexcept;
 void operator delete(void* ptr, std::size_t size) noexcept
 {
-  TracyFreeS(ptr, 5);
-  ZoneNamedNC(x, "delete", 0x003300, ZONES);
+  auto reported = ReportFree(ptr, 2);
+  ZoneNamedNC(x, "delete", 0x003300, ZONES && reported);
   orig_free(ptr);
 }
 
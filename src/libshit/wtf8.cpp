@@ -1,14 +1,25 @@
 #include "libshit/wtf8.hpp"
 
 #include "libshit/assert.hpp"
+#include "libshit/container/simple_vector.hpp"
 #include "libshit/doctest.hpp"
+#include "libshit/low_io.hpp"
+#include "libshit/random.hpp"
+#include "libshit/simd_utils.hpp"
+#include "libshit/utils.hpp"
 
 #include <boost/config.hpp>
 #include <boost/endian/conversion.hpp>
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <functional>
+#include <iterator>
+#include <memory>
 #include <ostream> // op<< used by doctest...
+#include <type_traits>
 
 namespace Libshit
 {
@@ -39,6 +50,97 @@ namespace Libshit
   //   0x10000..0x10ffff -> 6
 
   static std::uint16_t NoConv(std::uint16_t c) { return c; }
+  // the only other Conv functions used are little <-> native conversions
+  template <std::uint16_t (*Conv)(std::uint16_t)>
+  constexpr bool CONV_IS_NOOP =
+    boost::endian::order::native == boost::endian::order::little;
+  template <> constexpr bool CONV_IS_NOOP<NoConv> = true;
+
+  // ASCII fast path helpers: most of the text we convert is ASCII, so find
+  // ASCII runs and copy/widen/narrow them in bulk
+  static std::size_t AsciiPrefix(const char* p, std::size_t n) noexcept
+  {
+    std::size_t i = 0;
+#if LIBSHIT_HAS_SSE2
+    for (; i + 16 <= n; i += 16)
+      if (unsigned m = _mm_movemask_epi8(Simd::Load16(p + i)))
+        return i + Simd::CountTrailingZeros(m);
+#endif
+    for (; i + 8 <= n; i += 8)
+      if (Simd::Load8(p + i) & Simd::HIGH8) break;
+    while (i < n && static_cast<unsigned char>(p[i]) < 0x80) ++i;
+    return i;
+  }
+
+  static std::size_t AsciiPrefix(const char16_t* p, std::size_t n) noexcept
+  {
+    std::size_t i = 0;
+#if LIBSHIT_HAS_SSE2
+    auto mask = _mm_set1_epi16(static_cast<short>(0xff80));
+    for (; i + 8 <= n; i += 8)
+    {
+      auto ascii = _mm_cmpeq_epi16(
+        _mm_and_si128(Simd::Load16(p + i), mask), _mm_setzero_si128());
+      if (unsigned m = _mm_movemask_epi8(ascii) ^ 0xffff)
+        return i + Simd::CountTrailingZeros(m) / 2;
+    }
+#endif
+    for (; i + 4 <= n; i += 4)
+      if (Simd::Load8(p + i) & 0xff80ff80ff80ff80) break;
+    while (i < n && p[i] < 0x80) ++i;
+    return i;
+  }
+
+  static void CopyAscii(char* o, const char* p, std::size_t n) noexcept
+  { if (n) std::memcpy(o, p, n); }
+
+  template <typename T>
+  static void CopyAscii(T* o, const char* p, std::size_t n) noexcept
+  {
+    static_assert(sizeof(T) == 2);
+    std::size_t i = 0;
+#if LIBSHIT_HAS_SSE2
+    auto zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16)
+    {
+      auto x = Simd::Load16(p + i);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(o + i),
+                       _mm_unpacklo_epi8(x, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(o + i + 8),
+                       _mm_unpackhi_epi8(x, zero));
+    }
+#endif
+    for (; i < n; ++i) o[i] = static_cast<unsigned char>(p[i]);
+  }
+
+  // every char must be < 0x80
+  static void CopyAscii(char* o, const char16_t* p, std::size_t n) noexcept
+  {
+    std::size_t i = 0;
+#if LIBSHIT_HAS_SSE2
+    for (; i + 16 <= n; i += 16)
+      _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(o + i),
+        _mm_packus_epi16(Simd::Load16(p + i), Simd::Load16(p + i + 8)));
+#endif
+    for (; i < n; ++i) o[i] = static_cast<char>(p[i]);
+  }
+
+  template <typename T, typename = void>
+  constexpr bool HAS_ASCII = false;
+  template <typename T>
+  constexpr bool HAS_ASCII<T, std::void_t<decltype(
+    std::declval<T&>().Ascii(std::declval<const char*>(), 0))>> = true;
+
+  /// Feed an ASCII run to a producer, in bulk if it supports it
+  template <typename Out>
+  static void PutAscii(Out& out, const char* p, std::size_t n)
+  {
+    if constexpr (HAS_ASCII<Out>) out.Ascii(p, n);
+    else
+      for (std::size_t i = 0; i < n; ++i)
+        out(static_cast<char32_t>(static_cast<unsigned char>(p[i])));
+  }
 
   namespace
   {
@@ -78,20 +180,58 @@ namespace Libshit
 
   namespace
   {
+    // output sinks: append to a string, only count the length or write into
+    // a caller provided buffer
     template <typename T>
     struct PushBack
     {
       T& out;
       template <typename U> void operator()(U u) { out.push_back(u); }
+      template <typename C> void Ascii(const C* p, std::size_t n)
+      {
+        auto old_size = out.size();
+        out.resize(old_size + n);
+        CopyAscii(out.data() + old_size, p, n);
+      }
     };
     template <typename T> PushBack(T&) -> PushBack<T>;
 
+    struct Count
+    {
+      std::size_t& n;
+      template <typename U> void operator()(U) noexcept { ++n; }
+      template <typename C> void Ascii(const C*, std::size_t m) noexcept
+      { n += m; }
+    };
+
+    [[noreturn]] void BufferTooSmall()
+    { LIBSHIT_THROW(std::length_error, "Wtf8: output buffer too small"); }
+
+    template <typename T>
+    struct SpanOut
+    {
+      T*& cur;
+      T* end;
+      template <typename U> void operator()(U u)
+      {
+        if (cur == end) BufferTooSmall();
+        *cur++ = u;
+      }
+      template <typename C> void Ascii(const C* p, std::size_t n)
+      {
+        if (static_cast<std::size_t>(end - cur) < n) BufferTooSmall();
+        CopyAscii(cur, p, n);
+        cur += n;
+      }
+    };
+
     template <typename Out>
     struct Utf8Producer
     {
       Out out;
       bool overlong_0;
       void operator()(char32_t cp);
+      void Ascii(const char* p, std::size_t n);
     };
     template <typename T> Utf8Producer(T, bool) -> Utf8Producer<T>;
   }
@@ -126,43 +266,100 @@ namespace Libshit
     }
   }
 
-  template <std::uint16_t (*Conv)(std::uint16_t)>
-  static void GenWtf16ToWtf8(std::string& out, U16StringView in, bool replace)
+  template <typename Out>
+  void Utf8Producer<Out>::Ascii(const char* p, std::size_t n)
   {
-    out.reserve(out.size() + in.size() * 3);
-    auto p = MkUtf16Parse<Conv>(Utf8Producer{PushBack{out}, false}, replace);
-    for (const char16_t c : in) p(c);
-    p(0); // flush
+    if (!overlong_0) return PutAscii(out, p, n);
+
+    auto end = p + n;
+    while (p != end)
+    {
+      auto zero = std::find(p, end, '\0');
+      PutAscii(out, p, zero - p);
+      if (zero == end) break;
+      (*this)(0);
+      p = zero + 1;
+    }
   }
 
-#define LIBSHIT_GEN0(a_name, b_name, conv, replace)           \
-  void a_name##To##b_name(std::string& out, U16StringView in) \
-  { GenWtf16ToWtf8<conv>(out, in, replace); }
-#define LIBSHIT_GEN(a_name, b_name, replace)                                 \
-  LIBSHIT_GEN0(a_name, b_name, NoConv, replace)                              \
-  LIBSHIT_GEN0(a_name##LE, b_name, boost::endian::little_to_native, replace) \
+  // Fast=false: plain scalar implementation, only used to test the fast path
+  template <bool Fast, typename Parse, typename Sink>
+  static void Wtf16ToWtf8Feed(Parse& p, Sink out, U16StringView in)
+  {
+    for (std::size_t i = 0, n = in.size(); i < n; )
+    {
+      if constexpr (Fast)
+      {
+        auto run = AsciiPrefix(in.data() + i, n - i);
+        if (run >= 2)
+        {
+          // the parser lags one char behind: flush the previous char, output
+          // everything except the last ascii char and leave it pending
+          p(in[i]);
+          out.Ascii(in.data() + i, run - 1);
+          p.prev = in[i + run - 1];
+          i += run;
+          continue;
+        }
+      }
+      p(in[i++]);
+    }
+  }
 
-  LIBSHIT_GEN(Wtf16, Wtf8, false)
-  LIBSHIT_GEN(Utf16, Utf8, true)
-#undef LIBSHIT_GEN
-#undef LIBSHIT_GEN0
+  template <std::uint16_t (*Conv)(std::uint16_t), bool Replace,
+            bool Fast = true, typename Sink>
+  static void GenWtf16ToWtf8(Sink out, U16StringView in)
+  {
+    auto p = MkUtf16Parse<Conv>(Utf8Producer{out, false}, Replace);
+    Wtf16ToWtf8Feed<Fast>(p, out, in);
+    p(0); // flush
+  }
 
-  template <std::uint16_t (*Conv)(std::uint16_t)>
-  static void GenWtf16ToCesu8(std::string& out, U16StringView in)
+  template <std::uint16_t (*Conv)(std::uint16_t), bool Fast = true,
+            typename Sink>
+  static void GenWtf16ToCesu8(Sink out, U16StringView in)
   {
-    out.reserve(out.size() + in.size() * 3);
-    Utf8Producer p{PushBack{out}, true};
-    for (const char16_t c : in) p(c);
+    Utf8Producer p{out, true};
+    for (std::size_t i = 0, n = in.size(); i < n; )
+    {
+      if constexpr (Fast)
+      {
+        // NUL is not ASCII in CESU-8 (overlong encoded)
+        auto run = AsciiPrefix(in.data() + i, n - i);
+        run = std::find(in.data() + i, in.data() + i + run, u'\0') -
+          (in.data() + i);
+        if (run)
+        {
+          out.Ascii(in.data() + i, run);
+          i += run;
+          continue;
+        }
+      }
+      p(in[i++]);
+    }
   }
 
-  void Wtf16ToCesu8(std::string& out, U16StringView in)
-  { GenWtf16ToCesu8<NoConv>(out, in); }
+  namespace
+  {
+    enum class OnError { THROW, STOP, REPLACE };
+
+    // resumable UTF-8/WTF-8/CESU-8 decoder, input can be fed in chunks
+    struct Utf8Parser
+    {
+      int rem_chars = 0;
+      std::uint8_t st = 0;
+      char32_t cp = 0;
 
-  void Wtf16LEToCesu8(std::string& out, U16StringView in)
-  { GenWtf16ToCesu8<boost::endian::little_to_native>(out, in); }
+      // returns the offset of the first error (or npos) when not throwing
+      template <bool Fast = true, OnError Err = OnError::THROW, typename Out>
+      std::size_t Feed(StringView in, Out out);
+      void Finish() const
+      { if (rem_chars != 0) LIBSHIT_THROW(Wtf8DecodeError, "Invalid WTF-8"); }
+    };
+  }
 
-  template <typename Out>
-  static void Utf8Parse(StringView in, Out out)
+  template <bool Fast, OnError Err, typename Out>
+  std::size_t Utf8Parser::Feed(StringView in, Out out)
   {
 #define P(len, extra) ((len) | ((extra) << 3))
     static constexpr uint8_t buf[32] = {
@@ -177,28 +374,93 @@ namespace Libshit
 #undef P
     };
 
-    int rem_chars = 0;
-    uint8_t st = 0;
-    char32_t cp;
-    for (char cc : in)
+    auto err = StringView::npos;
+    for (std::size_t i = 0, n = in.size(); i < n; )
     {
-      auto c = static_cast<unsigned char>(cc);
+      if constexpr (Fast)
+      {
+        if (rem_chars == 0)
+        {
+          auto run = AsciiPrefix(in.data() + i, n - i);
+          if (run)
+          {
+            PutAscii(out, in.data() + i, run);
+            i += run;
+            continue;
+          }
+        }
+      }
+
+      auto c = static_cast<unsigned char>(in[i++]);
       if (rem_chars == 0)
       {
         st = buf[c >> 3];
         rem_chars = st & 7;
-        if (BOOST_UNLIKELY(rem_chars == 0))
-          LIBSHIT_THROW(Wtf8DecodeError, "Invalid WTF-8");
+        // the throwing version is lenient for speed, the non-throwing ones
+        // also reject C1 and F5..F7 lead bytes
+        if (BOOST_UNLIKELY(rem_chars == 0 || (
+              Err != OnError::THROW && (c == 0xc1 || c >= 0xf5))))
+        {
+          if constexpr (Err == OnError::THROW)
+            LIBSHIT_THROW(Wtf8DecodeError, "Invalid WTF-8");
+          else
+          {
+            rem_chars = 0;
+            if (err == StringView::npos) err = i - 1;
+            if constexpr (Err == OnError::STOP) return err;
+            out(char32_t(0xfffd));
+            continue;
+          }
+        }
         cp = (st & 0xf8) | (c & 7);
       }
       else
+      {
+        if constexpr (Err != OnError::THROW)
+        {
+          // not a continuation byte, or the second byte of an overlong (except
+          // the CESU-8 NUL) or > U+10FFFF sequence. Here cp only contains the
+          // low bits of the lead byte.
+          auto len = st & 7;
+          bool second = rem_chars == len - 1;
+          if (BOOST_UNLIKELY(
+                (c & 0xc0) != 0x80 ||
+                (second && len == 2 && cp == 0 && c != 0x80) ||
+                (second && len == 3 && cp == 0 && c < 0xa0) ||
+                (second && len == 4 && cp == 0 && c < 0x90) ||
+                (second && len == 4 && cp == 4 && c >= 0x90)))
+          {
+            // report the lead byte, continue with this byte
+            if (err == StringView::npos) err = i - 1 - (len - rem_chars);
+            if constexpr (Err == OnError::STOP) return err;
+            out(char32_t(0xfffd));
+            rem_chars = 0;
+            --i;
+            continue;
+          }
+        }
         cp = (cp << 6) | (c & 0x3f);
+      }
 
       if (--rem_chars == 0)
         out(cp);
     }
+    return err;
+  }
 
-    if (rem_chars != 0) LIBSHIT_THROW(Wtf8DecodeError, "Invalid WTF-8");
+  template <bool Fast = true, OnError Err = OnError::THROW, typename Out>
+  static std::size_t Utf8Parse(StringView in, Out out)
+  {
+    Utf8Parser p;
+    auto err = p.Feed<Fast, Err>(in, out);
+    if constexpr (Err == OnError::THROW) p.Finish();
+    else if (p.rem_chars != 0) // truncated sequence
+    {
+      if (err == StringView::npos)
+        err = in.size() - ((p.st & 7) - p.rem_chars);
+      if constexpr (Err == OnError::REPLACE) out(char32_t(0xfffd));
+    }
+    return err;
   }
 
   namespace
@@ -208,6 +470,7 @@ namespace Libshit
     {
       Out out;
       void operator()(char32_t cp);
+      void Ascii(const char* p, std::size_t n);
     };
   }
   template <std::uint16_t (*Conv)(std::uint16_t), typename Out>
@@ -227,53 +490,416 @@ namespace Libshit
   }
 
   template <std::uint16_t (*Conv)(std::uint16_t), typename Out>
-  void GenWtf8ToWtf16(Out& out, StringView in)
+  void Utf16Producer<Conv, Out>::Ascii(const char* p, std::size_t n)
   {
-    out.reserve(out.size() + in.size());
-    Utf8Parse(in, MkUtf16Producer<Conv>(PushBack{out}));
+    if constexpr (CONV_IS_NOOP<Conv>) PutAscii(out, p, n);
+    else
+      for (std::size_t i = 0; i < n; ++i)
+        (*this)(static_cast<unsigned char>(p[i]));
   }
 
-#define LIBSHIT_GEN(name)                                  \
-  void name##ToWtf16(std::u16string& out, StringView in)   \
-  { GenWtf8ToWtf16<NoConv>(out, in); }                     \
-                                                           \
-  void name##ToWtf16LE(std::u16string& out, StringView in) \
-  { GenWtf8ToWtf16<boost::endian::native_to_little>(out, in); }
-  LIBSHIT_GEN(Wtf8)
-  LIBSHIT_GEN(Cesu8)
-#undef LIBSHIT_GEN
+  template <std::uint16_t (*Conv)(std::uint16_t), bool Fast = true,
+            OnError Err = OnError::THROW, typename Sink>
+  static std::size_t GenWtf8ToWtf16(Sink out, StringView in)
+  { return Utf8Parse<Fast, Err>(in, MkUtf16Producer<Conv>(out)); }
 
-  // cesu <-> utf8
-  void Wtf8ToCesu8(std::string& out, StringView in)
+  template <OnError Err = OnError::THROW, typename Sink>
+  static std::size_t GenWtf8ToCesu8(Sink out, StringView in)
   {
-    out.reserve(out.size() + in.size() * 3 / 2);
-    Utf8Parse(in, MkUtf16Producer<NoConv>(Utf8Producer{PushBack{out}, true}));
+    return Utf8Parse<true, Err>(
+      in, MkUtf16Producer<NoConv>(Utf8Producer{out, true}));
   }
 
-  void Cesu8ToWtf8(std::string& out, StringView in)
+  template <OnError Err = OnError::THROW, typename Sink>
+  static std::size_t GenCesu8ToWtf8(Sink out, StringView in)
   {
-    out.reserve(out.size() + in.size());
-    auto p = MkUtf16Parse<NoConv>(Utf8Producer{PushBack{out}, false}, false);
-    Utf8Parse(in, std::ref(p));
+    auto p = MkUtf16Parse<NoConv>(Utf8Producer{out, false}, false);
+    auto err = Utf8Parse<true, Err>(in, std::ref(p));
     p(0); // flush
+    return err;
+  }
+
+  // generate the appending, length counting and span versions of a conversion
+#define LIBSHIT_GEN0(a_type, a_name, b_str, b_name, worst, gen)            \
+  void a_name##To##b_name(b_str& out, a_type in)                           \
+  {                                                                        \
+    out.reserve(out.size() + (worst));                                     \
+    gen(PushBack{out}, in);                                                \
+  }                                                                        \
+                                                                           \
+  std::size_t a_name##To##b_name##Length(a_type in)                        \
+  {                                                                        \
+    std::size_t n = 0;                                                     \
+    gen(Count{n}, in);                                                     \
+    return n;                                                              \
+  }                                                                        \
+                                                                           \
+  std::size_t a_name##To##b_name(Span<b_str::value_type> out, a_type in)   \
+  {                                                                        \
+    auto cur = out.data();                                                 \
+    gen(SpanOut<b_str::value_type>{cur, cur + out.size()}, in);            \
+    return cur - out.data();                                               \
+  }
+#define LIBSHIT_GEN(a_type, a_name, b_str, b_name, worst, gen, le_gen)     \
+  LIBSHIT_GEN0(a_type, a_name, b_str, b_name, worst, gen)                  \
+  LIBSHIT_GEN0(a_type, a_name##LE, b_str, b_name, worst, le_gen)
+
+  LIBSHIT_GEN(U16StringView, Wtf16, std::string, Wtf8, in.size() * 3,
+              (GenWtf16ToWtf8<NoConv, false>),
+              (GenWtf16ToWtf8<boost::endian::little_to_native, false>))
+  LIBSHIT_GEN(U16StringView, Utf16, std::string, Utf8, in.size() * 3,
+              (GenWtf16ToWtf8<NoConv, true>),
+              (GenWtf16ToWtf8<boost::endian::little_to_native, true>))
+  LIBSHIT_GEN(U16StringView, Wtf16, std::string, Cesu8, in.size() * 3,
+              GenWtf16ToCesu8<NoConv>,
+              GenWtf16ToCesu8<boost::endian::little_to_native>)
+#undef LIBSHIT_GEN
+
+#define LIBSHIT_GEN(a_name, b_name, gen)                                   \
+  LIBSHIT_GEN0(StringView, a_name, std::u16string, b_name, in.size(),      \
+               gen<NoConv>)                                                \
+  LIBSHIT_GEN0(StringView, a_name, std::u16string, b_name##LE, in.size(),  \
+               gen<boost::endian::native_to_little>)
+  LIBSHIT_GEN(Wtf8, Wtf16, GenWtf8ToWtf16)
+  LIBSHIT_GEN(Cesu8, Wtf16, GenWtf8ToWtf16)
+#undef LIBSHIT_GEN
+
+  // cesu <-> utf8
+  LIBSHIT_GEN0(StringView, Wtf8, std::string, Cesu8, in.size() * 3 / 2,
+               GenWtf8ToCesu8)
+  LIBSHIT_GEN0(StringView, Cesu8, std::string, Wtf8, in.size(),
+               GenCesu8ToWtf8)
+#undef LIBSHIT_GEN0
+
+  // non-throwing versions
+#define LIBSHIT_GEN(a_name, b_str, b_name, worst, gen)                      \
+  std::size_t a_name##To##b_name(b_str& out, StringView in, Wtf8OnError mode) \
+  {                                                                         \
+    out.reserve(out.size() + (worst));                                      \
+    if (mode == Wtf8OnError::STOP)                                          \
+      return gen<OnError::STOP>(PushBack{out}, in);                         \
+    else                                                                    \
+      return gen<OnError::REPLACE>(PushBack{out}, in);                      \
   }
+#define LIBSHIT_GEN16(a_name, b_name, conv)                                 \
+  template <OnError Err, typename Sink>                                     \
+  static std::size_t a_name##To##b_name##Gen(Sink out, StringView in)       \
+  { return GenWtf8ToWtf16<conv, true, Err>(out, in); }                     \
+  LIBSHIT_GEN(a_name, std::u16string, b_name, in.size(),                    \
+              a_name##To##b_name##Gen)
+  LIBSHIT_GEN16(Wtf8, Wtf16, NoConv)
+  LIBSHIT_GEN16(Wtf8, Wtf16LE, boost::endian::native_to_little)
+  LIBSHIT_GEN16(Cesu8, Wtf16, NoConv)
+  LIBSHIT_GEN16(Cesu8, Wtf16LE, boost::endian::native_to_little)
+  // replacement chars can be longer than the input
+  LIBSHIT_GEN(Wtf8, std::string, Cesu8, in.size() * 3, GenWtf8ToCesu8)
+  LIBSHIT_GEN(Cesu8, std::string, Wtf8, in.size() * 3, GenCesu8ToWtf8)
+#undef LIBSHIT_GEN16
+#undef LIBSHIT_GEN
 
 
 #if WCHAR_MAX == 65535
   void Wtf8ToWtf16Wstr(std::wstring& out, StringView in)
-  { GenWtf8ToWtf16<NoConv>(out, in); }
+  {
+    out.reserve(out.size() + in.size());
+    GenWtf8ToWtf16<NoConv>(PushBack{out}, in);
+  }
   void Wtf16ToWtf8(std::string& out, WStringView in)
   {
-    GenWtf16ToWtf8<NoConv>(out, {
-        reinterpret_cast<const char16_t*>(in.data()), in.size()}, false);
+    Wtf16ToWtf8(out, U16StringView{
+        reinterpret_cast<const char16_t*>(in.data()), in.size()});
   }
   void Utf16ToUtf8(std::string& out, WStringView in)
   {
-    GenWtf16ToWtf8<NoConv>(out, {
-        reinterpret_cast<const char16_t*>(in.data()), in.size()}, true);
+    Utf16ToUtf8(out, U16StringView{
+        reinterpret_cast<const char16_t*>(in.data()), in.size()});
   }
 #endif
 
+  // validation
+  namespace
+  {
+    enum class Encoding { UTF8, WTF8, CESU8 };
+  }
+
+  static bool IsCont(unsigned char c) noexcept { return (c & 0xc0) == 0x80; }
+
+  template <Encoding Enc>
+  static std::size_t FindInvalid(StringView in) noexcept
+  {
+    auto p = reinterpret_cast<const unsigned char*>(in.data());
+    bool prev_lead_surrogate = false;
+    for (std::size_t i = 0, n = in.size(); i < n; )
+    {
+      if (auto run = AsciiPrefix(in.data() + i, n - i))
+      {
+        prev_lead_surrogate = false;
+        if ((i += run) == n) break;
+      }
+
+      unsigned c = p[i];
+      std::size_t rem = n - i;
+      if (c < 0xc2) // continuation or overlong 2 byte
+      {
+        if (Enc == Encoding::CESU8 && c == 0xc0 && rem >= 2 && p[i+1] == 0x80)
+        {
+          prev_lead_surrogate = false;
+          i += 2;
+          continue;
+        }
+        return i;
+      }
+      else if (c < 0xe0)
+      {
+        if (rem < 2 || !IsCont(p[i+1])) return i;
+        prev_lead_surrogate = false;
+        i += 2;
+      }
+      else if (c < 0xf0)
+      {
+        if (rem < 3 || !IsCont(p[i+1]) || !IsCont(p[i+2])) return i;
+        if (c == 0xe0 && p[i+1] < 0xa0) return i; // overlong
+        bool lead = c == 0xed && p[i+1] < 0xb0 && p[i+1] >= 0xa0;
+        bool trail = c == 0xed && p[i+1] >= 0xb0;
+        if (Enc == Encoding::UTF8 && (lead || trail)) return i;
+        if (Enc == Encoding::WTF8 && trail && prev_lead_surrogate) return i;
+        prev_lead_surrogate = lead;
+        i += 3;
+      }
+      else if (Enc != Encoding::CESU8 && c < 0xf5)
+      {
+        if (rem < 4 || !IsCont(p[i+1]) || !IsCont(p[i+2]) || !IsCont(p[i+3]))
+          return i;
+        if (c == 0xf0 && p[i+1] < 0x90) return i; // overlong
+        if (c == 0xf4 && p[i+1] >= 0x90) return i; // > 0x10ffff
+        prev_lead_surrogate = false;
+        i += 4;
+      }
+      else
+        return i;
+    }
+    return StringView::npos;
+  }
+
+  std::size_t FindInvalidUtf8(StringView in) noexcept
+  { return FindInvalid<Encoding::UTF8>(in); }
+  std::size_t FindInvalidWtf8(StringView in) noexcept
+  { return FindInvalid<Encoding::WTF8>(in); }
+  std::size_t FindInvalidCesu8(StringView in) noexcept
+  { return FindInvalid<Encoding::CESU8>(in); }
+
+  // streaming
+  namespace
+  {
+    // write into a raw byte buffer, the caller must make sure there's enough
+    // space
+    template <typename T>
+    struct ByteOut
+    {
+      char*& cur;
+      template <typename U> void operator()(U u) noexcept
+      {
+        auto t = static_cast<T>(u);
+        std::memcpy(cur, &t, sizeof(T));
+        cur += sizeof(T);
+      }
+      template <typename C> void Ascii(const C* p, std::size_t n) noexcept
+      {
+        if constexpr (sizeof(T) == 1)
+        {
+          CopyAscii(cur, p, n);
+          cur += n;
+        }
+        else
+        {
+          T tmp[64];
+          while (n)
+          {
+            auto m = std::min(n, std::size(tmp));
+            CopyAscii(tmp, p, m);
+            std::memcpy(cur, tmp, m * sizeof(T));
+            cur += m * sizeof(T);
+            p += m;
+            n -= m;
+          }
+        }
+      }
+    };
+  }
+
+  // one input byte never produces more than 2 bytes of output, plus a
+  // sequence started in a previous chunk can complete
+  static constexpr std::size_t TRANSCODE_RATIO = 2;
+  static constexpr std::size_t TRANSCODE_CARRY = 6;
+  // at least one UTF-16 unit must fit
+  static_assert(Wtf8Transcoder::MIN_OUTPUT_SIZE >=
+                TRANSCODE_CARRY + 2 * TRANSCODE_RATIO);
+
+  static bool IsUtf16Input(Wtf8Transcoder::Conversion conv) noexcept
+  {
+    using C = Wtf8Transcoder::Conversion;
+    switch (conv)
+    {
+    case C::WTF16_TO_WTF8: case C::WTF16LE_TO_WTF8:
+    case C::UTF16_TO_UTF8: case C::UTF16LE_TO_UTF8:
+    case C::WTF16_TO_CESU8: case C::WTF16LE_TO_CESU8:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // input can be unaligned and maybe little endian, so copy it into properly
+  // aligned native endian chunks
+  template <typename Fun>
+  static void Utf16Chunks(const char* in, std::size_t n, bool le, Fun fun)
+  {
+    LIBSHIT_ASSERT(n % 2 == 0);
+    char16_t tmp[256];
+    while (n)
+    {
+      auto m = std::min(n / 2, std::size(tmp));
+      std::memcpy(tmp, in, m * 2);
+      if constexpr (!CONV_IS_NOOP<boost::endian::little_to_native>)
+        if (le)
+          for (std::size_t i = 0; i < m; ++i)
+            tmp[i] = boost::endian::little_to_native(std::uint16_t(tmp[i]));
+      fun(U16StringView{tmp, m});
+      in += m * 2;
+      n -= m * 2;
+    }
+  }
+
+  void Wtf8Transcoder::Feed(const char* in, std::size_t n, char*& cur)
+  {
+    using C = Conversion;
+    Utf8Parser u8{rem_chars, st, cp};
+    switch (conv)
+    {
+    case C::WTF8_TO_WTF16: case C::CESU8_TO_WTF16:
+      u8.Feed({in, n}, MkUtf16Producer<NoConv>(ByteOut<char16_t>{cur}));
+      break;
+    case C::WTF8_TO_WTF16LE: case C::CESU8_TO_WTF16LE:
+      u8.Feed({in, n}, MkUtf16Producer<boost::endian::native_to_little>(
+                ByteOut<char16_t>{cur}));
+      break;
+
+    case C::WTF16_TO_WTF8: case C::WTF16LE_TO_WTF8:
+    case C::UTF16_TO_UTF8: case C::UTF16LE_TO_UTF8:
+    {
+      ByteOut<char> out{cur};
+      auto p = MkUtf16Parse<NoConv>(
+        Utf8Producer{out, false},
+        conv == C::UTF16_TO_UTF8 || conv == C::UTF16LE_TO_UTF8);
+      p.prev = prev;
+      auto le = conv == C::WTF16LE_TO_WTF8 || conv == C::UTF16LE_TO_UTF8;
+      Utf16Chunks(in, n, le, [&](U16StringView s)
+                  { Wtf16ToWtf8Feed<true>(p, out, s); });
+      prev = p.prev;
+      break;
+    }
+
+    case C::WTF16_TO_CESU8: case C::WTF16LE_TO_CESU8:
+      Utf16Chunks(in, n, conv == C::WTF16LE_TO_CESU8, [&](U16StringView s)
+                  { GenWtf16ToCesu8<NoConv>(ByteOut<char>{cur}, s); });
+      break;
+
+    case C::WTF8_TO_CESU8:
+      u8.Feed({in, n}, MkUtf16Producer<NoConv>(
+                Utf8Producer{ByteOut<char>{cur}, true}));
+      break;
+    case C::CESU8_TO_WTF8:
+    {
+      auto p = MkUtf16Parse<NoConv>(
+        Utf8Producer{ByteOut<char>{cur}, false}, false);
+      p.prev = prev;
+      u8.Feed({in, n}, std::ref(p));
+      prev = p.prev;
+      break;
+    }
+    }
+    rem_chars = u8.rem_chars;
+    st = u8.st;
+    cp = u8.cp;
+  }
+
+  auto Wtf8Transcoder::Convert(Span<const char> in, Span<char> out) -> Result
+  {
+    auto ip = in.data(), iend = ip + in.size();
+    auto cur = out.data(), end = cur + out.size();
+    bool utf16 = IsUtf16Input(conv);
+    // how many input bytes can we process without overflowing out
+    auto max_in = [&]() -> std::size_t
+    {
+      std::size_t space = end - cur;
+      return space > TRANSCODE_CARRY ?
+        (space - TRANSCODE_CARRY) / TRANSCODE_RATIO : 0;
+    };
+
+    if (has_odd && ip != iend && max_in() >= 2)
+    {
+      const char unit[2] = { odd, *ip++ };
+      has_odd = false;
+      Feed(unit, 2, cur);
+    }
+    while (!has_odd && ip != iend)
+    {
+      std::size_t n = std::min<std::size_t>(iend - ip, max_in());
+      if (utf16) n &= ~std::size_t(1);
+      if (n == 0) break;
+      Feed(ip, n, cur);
+      LIBSHIT_ASSERT(cur <= end);
+      ip += n;
+    }
+    if (utf16 && !has_odd && iend - ip == 1)
+    {
+      has_odd = true;
+      odd = *ip++;
+    }
+
+    return {std::size_t(ip - in.data()), std::size_t(cur - out.data())};
+  }
+
+  std::size_t Wtf8Transcoder::Finish(Span<char> out)
+  {
+    LIBSHIT_ASSERT(out.size() >= MIN_OUTPUT_SIZE);
+    auto incomplete = rem_chars != 0;
+    auto odd_bytes = has_odd;
+    auto cur = out.data();
+    // feed a NUL to flush the pending UTF-16 unit, like the non streaming
+    // functions
+    static constexpr const char zeros[2] = {};
+    if (!incomplete && !odd_bytes && prev != 0xffffffff)
+      Feed(zeros, IsUtf16Input(conv) ? 2 : 1, cur);
+
+    *this = Wtf8Transcoder{conv};
+    if (incomplete) LIBSHIT_THROW(Wtf8DecodeError, "Invalid WTF-8");
+    if (odd_bytes)
+      LIBSHIT_THROW(Wtf8DecodeError, "Invalid UTF-16: odd number of bytes");
+    return cur - out.data();
+  }
+
+  void Wtf8Transcoder::Transcode(
+    const LowIo& in, const LowIo& out, std::size_t chunk_size)
+  {
+    LIBSHIT_ASSERT(chunk_size);
+    auto out_size = (chunk_size + 2) * TRANSCODE_RATIO + TRANSCODE_CARRY;
+    std::unique_ptr<char[]> buf{new char[chunk_size + out_size]};
+    Span<char> obuf{buf.get() + chunk_size, out_size};
+
+    while (auto n = in.ReadSome(buf.get(), chunk_size))
+    {
+      Span<const char> chunk{buf.get(), n};
+      while (!chunk.empty())
+      {
+        auto res = Convert(chunk, obuf);
+        out.Write(obuf.data(), res.written);
+        chunk = chunk.subspan(res.read, chunk.size() - res.read);
+      }
+    }
+    out.Write(obuf.data(), Finish(obuf));
+  }
+
   TEST_CASE("Conversion")
   {
     auto check = [](
@@ -326,6 +952,341 @@ namespace Libshit
     check("\0xy"_ns, "\0xy"_ns, "\xc0\x80xy", u"\0xy"_ns, "\0\0x\0y\0");
   }
 
+  TEST_CASE("Exact size")
+  {
+    char16_t u16_raw[] = { 'a', 0xfc, 0x732b, 0xd83d, 0xdca9, 0xdca9, 0, 'b' };
+    U16StringView u16{u16_raw, std::size(u16_raw)};
+    auto w8 = Wtf16ToWtf8(u16);
+    auto c8 = Wtf16ToCesu8(u16);
+
+    CHECK(Wtf16ToWtf8Length(u16) == w8.size());
+    CHECK(Utf16ToUtf8Length(u16) == Utf16ToUtf8(u16).size());
+    CHECK(Wtf16ToCesu8Length(u16) == c8.size());
+    CHECK(Wtf8ToWtf16Length(w8) == u16.size());
+    CHECK(Cesu8ToWtf16Length(c8) == u16.size());
+    CHECK(Wtf8ToCesu8Length(w8) == c8.size());
+    CHECK(Cesu8ToWtf8Length(c8) == w8.size());
+    CHECK_THROWS_AS(Wtf8ToWtf16Length("\xc3"), Wtf8DecodeError);
+
+    char buf[32];
+    auto n = Wtf16ToCesu8(Span<char>{buf}, u16);
+    CHECK(StringView{buf, n} == c8);
+    CHECK_THROWS_AS(Wtf16ToCesu8(Span<char>{buf, c8.size() - 1}, u16),
+                    std::length_error);
+
+    // arena style: pack several strings into one buffer
+    char16_t buf16[32];
+    auto n16 = Wtf8ToWtf16(Span<char16_t>{buf16}, w8);
+    n16 += Wtf8ToWtf16(Span<char16_t>{buf16 + n16, 32 - n16}, "xyz");
+    CHECK(std::u16string(buf16, n16) == std::u16string(u16) + u"xyz");
+
+    SimpleVector<char16_t> vec;
+    Wtf8ToWtf16(vec, w8);
+    CHECK(vec.capacity() == u16.size());
+    Wtf8ToWtf16(vec, "<");
+    CHECK(vec.size() == u16.size() + 1);
+    CHECK(U16StringView{vec.data(), u16.size()} == u16);
+    CHECK(vec[u16.size()] == u'<');
+  }
+
+  // deterministic generator for the randomized tests
+  static Xoshiro128p TestRandom(std::uint32_t seed) noexcept
+  { return Xoshiro128p{{seed, 0x9e3779b9, 0x7f4a7c15, 0xf39cc060}}; }
+
+  /**
+   * Random string shorter than max_len: printable ASCII, with 1/extra_ratio
+   * chance of a NUL, a multibyte char or a surrogate.
+   */
+  static std::u16string RandomWtf16(
+    Xoshiro128p& rnd, std::uint32_t max_len, std::uint32_t extra_ratio)
+  {
+    static constexpr char16_t EXTRA[] = {
+      0, 0x7f, 0x80, 0xfc, 0x7ff, 0x800, 0x732b, 0xd83d, 0xdca9, 0xffff };
+    std::u16string res;
+    for (auto n = rnd.Gen<std::uint32_t>(max_len); n; --n)
+      if (rnd.Gen<std::uint32_t>(extra_ratio))
+        res.push_back(rnd.Gen<char16_t>(0x20, 0x7f));
+      else
+        res.push_back(EXTRA[rnd.Gen<std::uint32_t>(std::size(EXTRA))]);
+    return res;
+  }
+
+  TEST_CASE("ASCII fast path")
+  {
+    // mostly ASCII strings with some multibyte chars, surrogates and NULs at
+    // random positions, so runs end at every possible offset in a block
+    auto rnd = TestRandom(42);
+    for (int i = 0; i < 500; ++i)
+    {
+      auto u16 = RandomWtf16(rnd, 80, 8);
+      CAPTURE(i);
+
+      std::string fast, slow;
+      GenWtf16ToWtf8<NoConv, false, true>(PushBack{fast}, u16);
+      GenWtf16ToWtf8<NoConv, false, false>(PushBack{slow}, u16);
+      CHECK(fast == slow);
+      auto w8 = fast;
+
+      fast.clear(); slow.clear();
+      GenWtf16ToWtf8<NoConv, true, true>(PushBack{fast}, u16);
+      GenWtf16ToWtf8<NoConv, true, false>(PushBack{slow}, u16);
+      CHECK(fast == slow);
+
+      fast.clear(); slow.clear();
+      GenWtf16ToCesu8<NoConv, true>(PushBack{fast}, u16);
+      GenWtf16ToCesu8<NoConv, false>(PushBack{slow}, u16);
+      CHECK(fast == slow);
+
+      std::u16string fast16, slow16;
+      GenWtf8ToWtf16<NoConv, true>(PushBack{fast16}, w8);
+      GenWtf8ToWtf16<NoConv, false>(PushBack{slow16}, w8);
+      CHECK(fast16 == slow16);
+      CHECK(fast16 == u16);
+
+      fast16.clear(); slow16.clear();
+      GenWtf8ToWtf16<boost::endian::native_to_little, true>(
+        PushBack{fast16}, w8);
+      GenWtf8ToWtf16<boost::endian::native_to_little, false>(
+        PushBack{slow16}, w8);
+      CHECK(fast16 == slow16);
+
+      fast.clear(); slow.clear();
+      Utf8Parse<true>(w8, MkUtf16Producer<NoConv>(
+                        Utf8Producer{PushBack{fast}, true}));
+      Utf8Parse<false>(w8, MkUtf16Producer<NoConv>(
+                         Utf8Producer{PushBack{slow}, true}));
+      CHECK(fast == slow);
+      CHECK(fast == Wtf16ToCesu8(u16));
+    }
+  }
+
+  TEST_CASE("Non-throwing conversion")
+  {
+    constexpr auto NPOS = StringView::npos;
+    std::u16string u16;
+    CHECK(Wtf8ToWtf16(u16, u8"ab猫", Wtf8OnError::STOP) == NPOS);
+    CHECK(u16 == u"ab猫");
+
+    u16.clear();
+    CHECK(Wtf8ToWtf16(u16, "ab\x80" "cd", Wtf8OnError::STOP) == 2);
+    CHECK(u16 == u"ab");
+    u16.clear();
+    CHECK(Wtf8ToWtf16(u16, "ab\x80" "cd\xff", Wtf8OnError::REPLACE) == 2);
+    CHECK(u16 == u"ab\xfffd" "cd\xfffd");
+
+    // truncated
+    u16.clear();
+    CHECK(Wtf8ToWtf16(u16, "ab\xe7\x8c", Wtf8OnError::STOP) == 2);
+    CHECK(u16 == u"ab");
+    u16.clear();
+    CHECK(Cesu8ToWtf16LE(u16, "ab\xe7\x8c", Wtf8OnError::REPLACE) == 2);
+    CHECK(u16.size() == 3);
+
+    std::string str;
+    CHECK(Wtf8ToCesu8(str, "\x80x", Wtf8OnError::REPLACE) == 0);
+    CHECK(str == u8"�x");
+    str.clear();
+    CHECK(Cesu8ToWtf8(str, "x\xed\xa0\xbd\xed\xb2\xa9\xf8",
+                      Wtf8OnError::STOP) == 7);
+    CHECK(str == u8"x💩");
+    str.clear();
+    CHECK(Cesu8ToWtf8(str, "x\xf8\xed\xa0\xbd\xed\xb2\xa9",
+                      Wtf8OnError::REPLACE) == 1);
+    CHECK(str == u8"x�💩");
+
+    // lead byte followed by ASCII: the ASCII char is not eaten
+    u16.clear();
+    CHECK(Wtf8ToWtf16(u16, "\xc3" "A", Wtf8OnError::REPLACE) == 0);
+    CHECK(u16 == u"\xfffd" "A");
+    u16.clear();
+    CHECK(Wtf8ToWtf16(u16, "\xe7" "AB", Wtf8OnError::STOP) == 0);
+    CHECK(u16 == u"");
+    u16.clear();
+    CHECK(Wtf8ToWtf16(u16, "ab\xe7\x8c" "c", Wtf8OnError::REPLACE) == 2);
+    CHECK(u16 == u"ab\xfffd" "c");
+    str.clear();
+    CHECK(Wtf8ToCesu8(str, "x\xf0\x9f\x92" "A", Wtf8OnError::STOP) == 1);
+    CHECK(str == "x");
+
+    // overlong and out of range sequences
+    u16.clear();
+    CHECK(Wtf8ToWtf16(u16, "a\xc1\x81", Wtf8OnError::REPLACE) == 1);
+    CHECK(u16 == u"a\xfffd\xfffd");
+    u16.clear();
+    CHECK(Wtf8ToWtf16(u16, "\xe0\x80\x80", Wtf8OnError::REPLACE) == 0);
+    CHECK(u16 == u"\xfffd\xfffd\xfffd");
+    u16.clear();
+    CHECK(Wtf8ToWtf16(u16, "\xf4\x90\x80\x80", Wtf8OnError::STOP) == 0);
+    u16.clear();
+    CHECK(Wtf8ToWtf16(u16, "\xf5\x80", Wtf8OnError::STOP) == 0);
+    u16.clear();
+    CHECK(Cesu8ToWtf16(u16, "a\xc0\x80", Wtf8OnError::STOP) == NPOS);
+    CHECK(u16 == std::u16string(u"a\0", 2));
+    u16.clear();
+    CHECK(Cesu8ToWtf16(u16, "a\xc0\x81", Wtf8OnError::STOP) == 1);
+  }
+
+  TEST_CASE("Validation")
+  {
+    constexpr auto NPOS = StringView::npos;
+    auto check = [](StringView str, std::size_t utf8, std::size_t wtf8,
+                    std::size_t cesu8)
+    {
+      CAPTURE(str);
+      CHECK(FindInvalidUtf8(str) == utf8);
+      CHECK(FindInvalidWtf8(str) == wtf8);
+      CHECK(FindInvalidCesu8(str) == cesu8);
+    };
+
+    check("", NPOS, NPOS, NPOS);
+    check("abc\0def"_ns, NPOS, NPOS, NPOS);
+    check(u8"Brütal 猫", NPOS, NPOS, NPOS);
+    check(u8"xx💩", NPOS, NPOS, 2);
+    check("ab\xed\xa0\xbd\xed\xb2\xa9", 2, 5, NPOS); // cesu pair
+    check("\xed\xb2\xa9\xed\xa0\xbd", 0, NPOS, NPOS); // reversed pair
+    check("\xed\xa0\xbdx", 0, NPOS, NPOS); // lone surrogate
+    check("a\xc0\x80", 1, 1, NPOS); // overlong NUL
+    check("a\xc1\xbf", 1, 1, 1); // overlong
+    check("\xe0\x9f\xbf", 0, 0, 0); // overlong
+    check("\xf0\x8f\xbf\xbf", 0, 0, 0); // overlong
+    check("\xf4\x90\x80\x80", 0, 0, 0); // too big
+    check("\xf5\x80\x80\x80", 0, 0, 0);
+    check("abc\x80", 3, 3, 3); // stray continuation
+    check("abc\xc3", 3, 3, 3); // truncated
+    check("abc\xe7\x8c", 3, 3, 3);
+    check("abc\xe7\x8cx", 3, 3, 3);
+    check("0123456789abcdef0123456789\xff", 26, 26, 26);
+
+    // everything the converters produce must be valid
+    auto rnd = TestRandom(7);
+    for (int i = 0; i < 200; ++i)
+    {
+      std::u16string u16;
+      for (auto n = rnd.Gen<std::uint32_t>(40); n; --n)
+        u16.push_back(rnd.Gen<bool>() ? rnd.Gen<char16_t>() :
+                      rnd.Gen<char16_t>(0x80));
+      CAPTURE(i);
+      CHECK(IsValidWtf8(Wtf16ToWtf8(u16)));
+      CHECK(IsValidUtf8(Utf16ToUtf8(u16)));
+      CHECK(IsValidCesu8(Wtf16ToCesu8(u16)));
+    }
+  }
+
+  TEST_CASE("Wtf8Transcoder")
+  {
+    using C = Wtf8Transcoder::Conversion;
+    auto rnd = TestRandom(1337);
+    auto bytes = [](const std::u16string& s)
+    {
+      return std::string(
+        reinterpret_cast<const char*>(s.data()), s.size() * 2);
+    };
+
+    for (int i = 0; i < 100; ++i)
+    {
+      auto u16 = RandomWtf16(rnd, 200, 4);
+      auto w8 = Wtf16ToWtf8(u16), c8 = Wtf16ToCesu8(u16);
+      auto u16le = bytes(Wtf8ToWtf16LE(w8));
+
+      std::pair<C, std::pair<std::string, std::string>> cases[] = {
+        {C::WTF8_TO_WTF16, {w8, bytes(u16)}},
+        {C::WTF8_TO_WTF16LE, {w8, u16le}},
+        {C::CESU8_TO_WTF16, {c8, bytes(u16)}},
+        {C::CESU8_TO_WTF16LE, {c8, u16le}},
+        {C::WTF16_TO_WTF8, {bytes(u16), w8}},
+        {C::WTF16LE_TO_WTF8, {u16le, w8}},
+        {C::UTF16_TO_UTF8, {bytes(u16), Utf16ToUtf8(u16)}},
+        {C::UTF16LE_TO_UTF8, {u16le, Utf16ToUtf8(u16)}},
+        {C::WTF16_TO_CESU8, {bytes(u16), c8}},
+        {C::WTF16LE_TO_CESU8, {u16le, c8}},
+        {C::WTF8_TO_CESU8, {w8, c8}},
+        {C::CESU8_TO_WTF8, {c8, w8}},
+      };
+      for (const auto& [conv, io] : cases)
+      {
+        CAPTURE(i); CAPTURE(int(conv));
+        Wtf8Transcoder t{conv};
+        std::string out;
+        char buf[64];
+        StringView in = io.first;
+        while (!in.empty())
+        {
+          // random splits
+          auto n = std::min<std::size_t>(
+            in.size(), rnd.Gen<std::size_t>(1, 21));
+          Span<const char> chunk{in.data(), n};
+          while (!chunk.empty())
+          {
+            auto res = t.Convert(chunk, {buf, rnd.Gen<std::size_t>(16, 64)});
+            out.append(buf, res.written);
+            chunk = chunk.subspan(res.read, chunk.size() - res.read);
+          }
+          in.remove_prefix(n);
+        }
+        out.append(buf, t.Finish(buf));
+        CHECK(out == io.second);
+      }
+    }
+
+    Wtf8Transcoder t{C::WTF8_TO_WTF16};
+    char buf[16];
+    CHECK(t.Convert(Span<const char>{"ab\xc3", 3}, buf).read == 3);
+    CHECK_THROWS_AS(t.Finish(buf), Wtf8DecodeError);
+    // reset after finish
+    CHECK(t.Convert(Span<const char>{"a", 1}, buf).written == 2);
+    CHECK(t.Finish(buf) == 0);
+
+    Wtf8Transcoder t16{C::WTF16_TO_WTF8};
+    CHECK(t16.Convert(Span<const char>{"a\0b", 3}, buf).written == 0);
+    CHECK_THROWS_AS(t16.Finish(buf), Wtf8DecodeError);
+  }
+
+  TEST_CASE("Wtf8Transcoder::Transcode")
+  {
+    using C = Wtf8Transcoder::Conversion;
+    static constexpr const char W8_FNAME[] = "libshit_test_transcode_w8";
+    static constexpr const char W16_FNAME[] = "libshit_test_transcode_w16";
+    AtScopeExit x{[]() { std::remove(W8_FNAME); std::remove(W16_FNAME); }};
+
+    std::string w8 = "header";
+    for (int i = 0; i < 1000; ++i)
+      w8 += "foo \xc3\xa1 \xed\xa0\xbd \xf0\x9f\x92\xa9";
+    auto u16 = Wtf8ToWtf16(StringView{w8}.substr(6));
+    auto read_all = [](const char* fname)
+    {
+      LowIo io{fname, LowIo::Permission::READ_ONLY, LowIo::Mode::OPEN_ONLY};
+      std::string res(io.GetSize(), '\0');
+      io.Read(res.data(), res.size());
+      return res;
+    };
+
+    {
+      LowIo io{W8_FNAME, LowIo::Permission::WRITE_ONLY,
+               LowIo::Mode::TRUNC_OR_CREATE};
+      io.Write(w8.data(), w8.size());
+    }
+    {
+      // start from the middle of the file, with odd sized chunks
+      LowIo in{W8_FNAME, LowIo::Permission::READ_ONLY, LowIo::Mode::OPEN_ONLY};
+      char header[6];
+      in.Read(header, 6);
+      LowIo out{W16_FNAME, LowIo::Permission::WRITE_ONLY,
+                LowIo::Mode::TRUNC_OR_CREATE};
+      Wtf8Transcoder{C::WTF8_TO_WTF16}.Transcode(in, out, 7);
+    }
+    CHECK(read_all(W16_FNAME) == std::string(
+            reinterpret_cast<const char*>(u16.data()), u16.size() * 2));
+
+    {
+      LowIo in{W16_FNAME, LowIo::Permission::READ_ONLY,
+               LowIo::Mode::OPEN_ONLY};
+      LowIo out{W8_FNAME, LowIo::Permission::WRITE_ONLY,
+                LowIo::Mode::TRUNC_OR_CREATE};
+      Wtf8Transcoder{C::WTF16_TO_WTF8}.Transcode(in, out);
+    }
+    CHECK(read_all(W8_FNAME) == w8.substr(6));
+  }
+
   // skip: very slow in non-optimized builds
   TEST_CASE("roundtrip" * doctest::skip(true))
   {
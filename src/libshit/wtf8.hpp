@@ -4,13 +4,16 @@
 
 #include "libshit/nonowning_string.hpp"
 #include "libshit/except.hpp"
+#include "libshit/span.hpp"
 
+#include <cstddef>
 #include <cstdint>
 #include <stdexcept>
 #include <string>
 
 namespace Libshit
 {
+  template <typename T, typename Allocator> class SimpleVector;
 
   LIBSHIT_GEN_EXCEPTION_TYPE(Wtf8DecodeError, std::runtime_error);
 
@@ -18,11 +21,29 @@ namespace Libshit
   // shrink_to_fit if you intend to keep these strings around for a long time.
   // Functions taking a `& out` will clear `out` but keep the allocation if it's
   // large enough for a worst-case output.
+  //
+  // If you need exact sizes, `XToYLength` returns the length of the converted
+  // string (without converting it), the `Span` overloads write into a caller
+  // provided buffer (throwing std::length_error if it's too small) and return
+  // the number of characters written, the `SimpleVector` overloads append with
+  // an exactly sized allocation.
 
-#define LIBSHIT_GEN0(a_type, a_name, b_type, b_name)       \
-  void a_name##To##b_name(b_type& out, a_type in);         \
-  inline b_type a_name##To##b_name(a_type in)              \
-  { b_type res; a_name##To##b_name(res, in); return res; }
+#define LIBSHIT_GEN0(a_type, a_name, b_type, b_name)                        \
+  void a_name##To##b_name(b_type& out, a_type in);                          \
+  inline b_type a_name##To##b_name(a_type in)                               \
+  { b_type res; a_name##To##b_name(res, in); return res; }                  \
+                                                                            \
+  std::size_t a_name##To##b_name##Length(a_type in);                        \
+  std::size_t a_name##To##b_name(Span<b_type::value_type> out, a_type in);  \
+  template <typename Alloc>                                                 \
+  void a_name##To##b_name(                                                  \
+    SimpleVector<b_type::value_type, Alloc>& out, a_type in)                \
+  {                                                                         \
+    std::size_t size = out.size(), n = a_name##To##b_name##Length(in);      \
+    out.reserve(size + n);                                                  \
+    out.uninitialized_resize(size + n);                                     \
+    a_name##To##b_name(Span<b_type::value_type>{out.data() + size, n}, in); \
+  }
 #define LIBSHIT_GEN(a_str, a_sv, a_name, b_str, b_sv, b_name) \
   LIBSHIT_GEN0(a_sv, a_name, b_str, b_name)                  \
   LIBSHIT_GEN0(b_sv, b_name, a_str, a_name)
@@ -44,15 +65,130 @@ namespace Libshit
   LIBSHIT_GEN0(U16StringView, Utf16, std::string, Utf8)
   LIBSHIT_GEN0(U16StringView, Utf16LE, std::string, Utf8)
 
+#undef LIBSHIT_GEN
+#undef LIBSHIT_GEN0
+
   // on windows, also support wchar_t
 #if WCHAR_MAX == 65535
-  LIBSHIT_GEN0(StringView, Wtf8, std::wstring, Wtf16Wstr)
-  LIBSHIT_GEN0(WStringView, Wtf16, std::string, Wtf8)
-  LIBSHIT_GEN0(WStringView, Utf16, std::string, Utf8)
+#define LIBSHIT_GEN(a_type, a_name, b_type, b_name)        \
+  void a_name##To##b_name(b_type& out, a_type in);         \
+  inline b_type a_name##To##b_name(a_type in)              \
+  { b_type res; a_name##To##b_name(res, in); return res; }
+
+  LIBSHIT_GEN(StringView, Wtf8, std::wstring, Wtf16Wstr)
+  LIBSHIT_GEN(WStringView, Wtf16, std::string, Wtf8)
+  LIBSHIT_GEN(WStringView, Utf16, std::string, Utf8)
+#undef LIBSHIT_GEN
 #endif
 
+  /// What to do on invalid input in the non-throwing conversions
+  enum class Wtf8OnError
+  {
+    STOP,    ///< stop at the first invalid byte
+    REPLACE, ///< replace invalid sequences with U+FFFD and continue
+  };
+
+  // Non-throwing versions of the conversions that can fail. Unlike the
+  // throwing ones, they check that multibyte sequences are well-formed (no
+  // missing continuation bytes, overlong encodings or code points above
+  // U+10FFFF; unpaired surrogates and the CESU-8 NUL are accepted). Return
+  // the offset of the lead byte of the first invalid sequence in `in`, or
+  // npos if there were no errors. In REPLACE mode every invalid sequence is
+  // replaced with one U+FFFD, and decoding continues with the byte that made
+  // it invalid. In STOP mode `out` contains everything converted before the
+  // error.
+#define LIBSHIT_GEN(a_name, b_type, b_name) \
+  std::size_t a_name##To##b_name(b_type& out, StringView in, Wtf8OnError mode);
+  LIBSHIT_GEN(Wtf8, std::u16string, Wtf16)
+  LIBSHIT_GEN(Wtf8, std::u16string, Wtf16LE)
+  LIBSHIT_GEN(Cesu8, std::u16string, Wtf16)
+  LIBSHIT_GEN(Cesu8, std::u16string, Wtf16LE)
+  LIBSHIT_GEN(Wtf8, std::string, Cesu8)
+  LIBSHIT_GEN(Cesu8, std::string, Wtf8)
 #undef LIBSHIT_GEN
-#undef LIBSHIT_GEN0
+
+  /**
+   * Strict validation, without converting anything. Returns the offset of
+   * the first invalid (or truncated) sequence, or npos if the whole string is
+   * valid.
+   * - UTF-8: RFC 3629, no overlong encodings, no surrogates.
+   * - WTF-8: UTF-8 that also allows unpaired surrogates (but a surrogate pair
+   *   must be encoded as a single 4 byte sequence).
+   * - CESU-8: no 4 byte sequences (surrogates are encoded separately), NUL
+   *   can be also encoded as `C0 80` (as produced by the *ToCesu8 functions).
+   *
+   * Note that the converters are more lenient, they don't reject everything
+   * that these functions do.
+   */
+  std::size_t FindInvalidUtf8(StringView in) noexcept;
+  std::size_t FindInvalidWtf8(StringView in) noexcept;
+  std::size_t FindInvalidCesu8(StringView in) noexcept;
+
+  inline bool IsValidUtf8(StringView in) noexcept
+  { return FindInvalidUtf8(in) == StringView::npos; }
+  inline bool IsValidWtf8(StringView in) noexcept
+  { return FindInvalidWtf8(in) == StringView::npos; }
+  inline bool IsValidCesu8(StringView in) noexcept
+  { return FindInvalidCesu8(in) == StringView::npos; }
+
+  class LowIo;
+
+  /**
+   * Incremental version of the above conversions, for large inputs that you
+   * don't want to keep in memory. Input is fed in arbitrary sized byte chunks
+   * (they can split multibyte sequences, surrogate pairs or UTF-16 code
+   * units), output is written into a bounded buffer. UTF-16 input and output
+   * is in native byte order, UTF-16LE in little endian.
+   */
+  class Wtf8Transcoder
+  {
+  public:
+    enum class Conversion
+    {
+      WTF8_TO_WTF16, WTF8_TO_WTF16LE, CESU8_TO_WTF16, CESU8_TO_WTF16LE,
+      WTF16_TO_WTF8, WTF16LE_TO_WTF8, UTF16_TO_UTF8, UTF16LE_TO_UTF8,
+      WTF16_TO_CESU8, WTF16LE_TO_CESU8, WTF8_TO_CESU8, CESU8_TO_WTF8,
+    };
+
+    /// Convert will only make progress if the output buffer is at least this
+    /// big.
+    static constexpr const std::size_t MIN_OUTPUT_SIZE = 16;
+
+    explicit Wtf8Transcoder(Conversion conv) noexcept : conv{conv} {}
+
+    struct Result { std::size_t read, written; };
+    /**
+     * Convert as much of `in` as fits into `out`. Call again with the
+     * remaining input and an emptied buffer until everything is read.
+     * @throw Wtf8DecodeError on invalid input.
+     */
+    Result Convert(Span<const char> in, Span<char> out);
+    /**
+     * Signal the end of input and flush the remaining output (`out` must be
+     * at least MIN_OUTPUT_SIZE). The transcoder is reset afterwards.
+     * @return number of bytes written.
+     * @throw Wtf8DecodeError if the input ended in an incomplete sequence.
+     */
+    std::size_t Finish(Span<char> out);
+
+    /// Convert `in` from its current position until EOF into `out`, using
+    /// buffers of `chunk_size`. `in` can be a pipe.
+    void Transcode(const LowIo& in, const LowIo& out,
+                   std::size_t chunk_size = 64*1024);
+
+  private:
+    void Feed(const char* in, std::size_t n, char*& out);
+
+    Conversion conv;
+    // utf-8 decoder state
+    int rem_chars = 0;
+    std::uint8_t st = 0;
+    char32_t cp = 0;
+    // utf-16 decoder state
+    char32_t prev = 0xffffffff;
+    bool has_odd = false;
+    char odd = 0;
+  };
 }
 
 #endif
@@ -0,0 +1,117 @@
+#include "libshit/function.hpp"
+
+#include "libshit/doctest.hpp"
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace Libshit
+{
+  TEST_SUITE_BEGIN("Libshit::Function");
+
+  namespace
+  {
+    template <typename T>
+    struct CountingAllocator
+    {
+      using value_type = T;
+      CountingAllocator(std::size_t* count) noexcept : count{count} {}
+      template <typename U>
+      CountingAllocator(const CountingAllocator<U>& o) noexcept
+        : count{o.count} {}
+
+      T* allocate(std::size_t n)
+      {
+        ++*count;
+        return std::allocator<T>{}.allocate(n);
+      }
+      void deallocate(T* p, std::size_t n) noexcept
+      {
+        --*count;
+        std::allocator<T>{}.deallocate(p, n);
+      }
+
+      std::size_t* count;
+    };
+
+    struct ThrowingMove
+    {
+      ThrowingMove() = default;
+      ThrowingMove(ThrowingMove&&) noexcept(false) {}
+      int operator()() const { return 7; }
+    };
+
+    int Twice(int i) { return 2*i; }
+  }
+
+  TEST_CASE("Function storage")
+  {
+    using F = Function<int ()>;
+    std::array<int, 16> big{};
+    big[15] = 3;
+    auto big_fun = [big]() { return big[15]; };
+
+    static_assert(F::IS_INLINE<int (*)()>);
+    static_assert(!F::IS_INLINE<decltype(big_fun)>);
+    static_assert(!F::IS_INLINE<ThrowingMove>);
+
+    F f{big_fun};
+    CHECK(f() == 3);
+    F g{Move(f)};
+    CHECK(g() == 3);
+
+    F h{ThrowingMove{}};
+    CHECK(h() == 7);
+  }
+
+  TEST_CASE("Function with allocator")
+  {
+    std::size_t count = 0;
+    CountingAllocator<char> alloc{&count};
+
+    {
+      std::array<int, 16> big{};
+      big[3] = 5;
+      Function<int (int) const> f{
+        std::allocator_arg, alloc, [big](int i) { return big[3] + i; }};
+      CHECK(count == 1);
+      CHECK(f(1) == 6);
+
+      auto g = Move(f);
+      CHECK(count == 1);
+      CHECK(g(2) == 7);
+    }
+    CHECK(count == 0);
+
+    {
+      Function<int ()> f{std::allocator_arg, alloc, []() { return 1; }};
+      CHECK(count == 0); // fits inline
+      CHECK(f() == 1);
+    }
+  }
+
+  TEST_CASE("FunctionView")
+  {
+    int calls = 0;
+    auto lambda = [&](int i) { ++calls; return i+1; };
+    auto call = [](FunctionView<int (int)> f, int i) { return f(i); };
+
+    CHECK(call(lambda, 1) == 2);
+    CHECK(call([](int i) { return i*3; }, 2) == 6);
+    CHECK(call(Twice, 4) == 8);
+    CHECK(call(&Twice, 5) == 10);
+    CHECK(call(FUNC<Twice>, 6) == 12);
+    CHECK(calls == 1);
+
+    auto append_x = [](std::string& s) { s += "x"; };
+    FunctionView<void (std::string&)> append = append_x;
+    std::string s = "a";
+    append(s);
+    append(s);
+    CHECK(s == "axx");
+  }
+
+  TEST_SUITE_END();
+}
@@ -54,6 +54,22 @@ namespace Libshit::Lua::Test
     CHECK(lua_gettop(vm) == 0);
   }
 
+  // the result refers to the converted argument
+  static const std::string& reffun(const std::string& str) { return str; }
+  TEST_CASE("function returning a reference to its argument")
+  {
+    State vm;
+    vm.PushFunction<reffun>();
+
+    vm.Push("a string that doesn't fit into the small string buffer");
+    lua_call(vm, 1, 1);
+    CHECK(vm.Get<std::string>() ==
+          "a string that doesn't fit into the small string buffer");
+    lua_pop(vm, 1);
+
+    CHECK(lua_gettop(vm) == 0);
+  }
+
   static std::tuple<bool, int, std::string> tuplefun(bool a, int n)
   {
     std::stringstream ss;
@@ -85,6 +85,9 @@ namespace Libshit::Lua
     bld.AddFunction<
       static_cast<int (::Libshit::Lua::Test::Baz::*)()>(&::Libshit::Lua::Test::Baz::GetRandom)
     >("get_random");
+    bld.AddFfiFunction<
+      static_cast<double (*)(double, int) noexcept>(::Libshit::Lua::Test::Baz::Scale)
+    >("scale");
 
   }
   static TypeRegister::StateRegister<::Libshit::Lua::Test::Baz> reg_libshit_lua_test_baz;
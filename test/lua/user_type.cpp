@@ -50,6 +50,8 @@ namespace Libshit::Lua::Test
       Baz() = default;
       void SetGlobal(int val) { global = val; }
       int GetRandom() { return 4; }
+      LIBSHIT_LUAGEN(ffi=true)
+      static double Scale(double a, int b) noexcept { return a*b; }
 
       LIBSHIT_DYNAMIC_OBJECT;
     };
@@ -121,6 +123,26 @@ namespace Libshit::Lua::Test
     CHECK(global == val);
   }
 
+#if LIBSHIT_LUA_HAS_FFI
+  static_assert(Detail::FfiSignature<double (*)(double, int) noexcept>::VALID);
+  static_assert(!Detail::FfiSignature<double (*)(double, int)>::VALID);
+  // these would return cdata
+  static_assert(!Detail::FfiSignature<std::int64_t (*)() noexcept>::VALID);
+  static_assert(!Detail::FfiSignature<std::uint64_t (*)() noexcept>::VALID);
+  static_assert(Detail::FfiSignature<int (*)(std::uint64_t) noexcept>::VALID);
+#endif
+
+  TEST_CASE("ffi function")
+  {
+    State vm;
+    vm.DoString(R"(
+local scale = libshit.lua.test.baz.scale
+local x = 0
+for i=1,100 do x = x + scale(1.5, i) end
+assert(x == 1.5*5050)
+)");
+  }
+
   TEST_CASE("field access")
   {
     State vm;
@@ -218,6 +240,41 @@ assert(m.ptr.y == 13, "m.ptr.y")
 )");
   }
 
+  TEST_CASE("lazy registration")
+  {
+    State vm;
+    auto registered = [&](const char* name)
+    {
+      auto ret = !lua_isnil(vm, (lua_rawgetp(vm, LUA_REGISTRYINDEX, name), -1));
+      lua_pop(vm, 1);
+      return ret;
+    };
+    CHECK(!registered(TYPE_NAME<A>));
+    CHECK(!registered(TYPE_NAME<Multi>));
+
+    SUBCASE("from lua")
+    {
+      vm.DoString(R"(
+local multi = libshit.lua.test.multi
+local m = multi()
+assert(multi == libshit.lua.test.multi)
+assert(multi.is(m))
+)");
+      CHECK(registered(TYPE_NAME<A>));
+      CHECK(registered(TYPE_NAME<Multi>));
+      CHECK(!registered(TYPE_NAME<Smart>));
+    }
+
+    SUBCASE("from C++")
+    {
+      vm.Push(MakeShared<B>());
+      lua_setglobal(vm, "b");
+      CHECK(registered(TYPE_NAME<B>));
+      CHECK(!registered(TYPE_NAME<A>));
+      vm.DoString("assert(libshit.lua.test.b.is(b) and b.y == 1)");
+    }
+  }
+
   TEST_SUITE_END();
 }
 
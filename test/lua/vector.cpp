@@ -0,0 +1,55 @@
+#include <libshit/container/vector.lua.hpp>
+
+#include <libshit/lua/base.hpp>
+
+#include <vector>
+
+#include <libshit/doctest.hpp>
+
+LIBSHIT_STD_VECTOR_LUAGEN(test_double, double);
+
+namespace Libshit::Lua::Test
+{
+  TEST_SUITE_BEGIN("Libshit::Lua::Vector");
+
+  TEST_CASE("number vector table conversion")
+  {
+    State vm;
+    vm.DoString(R"(
+local v = libshit.vector_test_double.new({1.5, 2, 3})
+assert(#v == 3)
+assert(v[0] == 1.5 and v[1] == 2 and v[2] == 3)
+
+local t = v:to_table()
+assert(t[0] == 1.5 and t[1] == 2 and t[2] == 3 and t[3] == nil)
+
+local ok = pcall(libshit.vector_test_double.new, {1, "foo", 3})
+assert(not ok)
+
+assert(#libshit.vector_test_double.new({}):to_table() == 0)
+local z = libshit.vector_test_double.new({[0]=4, 5}):to_table()
+assert(z[0] == 4 and z[1] == 5)
+)");
+  }
+
+#if LIBSHIT_LUA_HAS_FFI
+  TEST_CASE("ffi data access")
+  {
+    State vm;
+    vm.DoString(R"(
+local v = libshit.vector_test_double.new(4, 1)
+local p = v:data()
+assert(p[0] == 1 and p[3] == 1)
+p[2] = 7.5
+assert(v[2] == 7.5)
+)");
+
+    // without ffi
+    lua_pushnil(vm); // +1
+    lua_setfield(vm, LUA_REGISTRYINDEX, "libshit_ffi_cast"); // 0
+    vm.DoString("assert(libshit.vector_test_double.new(1):data() == nil)");
+  }
+#endif
+
+  TEST_SUITE_END();
+}